@@ -18,6 +18,10 @@ limitations under the License.
 
 #include "common.hpp"
 
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
 // These are the names of the transformations done before encoding / after decoding
 const std::vector<std::string> transforms = {"Channel_Compact", "YCoCg", "?? YCbCr ??", "PermutePlanes", "Bounds",  // color space / ranges
                                              "Palette_Alpha", "Palette", "Color_Buckets",  // sparse-color transforms
@@ -111,53 +115,51 @@ void initPropRanges(Ranges &propRanges, const ColorRanges &ranges, int p) {
 // This is a fall-back function which should be replaced by direct calls to the specific predict_and_calcProps_plane function
 ColorVal predict_and_calcProps(Properties &properties, const ColorRanges *ranges, const Image &image, const int z, const int p, const uint32_t r, const uint32_t c, ColorVal &min, ColorVal &max, const int predictor) ATTRIBUTE_HOT;
 ColorVal predict_and_calcProps(Properties &properties, const ColorRanges *ranges, const Image &image, const int z, const int p, const uint32_t r, const uint32_t c, ColorVal &min, ColorVal &max, const int predictor) {
-    image.getPlane(0).prepare_zoomlevel(z);
-    image.getPlane(p).prepare_zoomlevel(z);
-
+    // zoom views instead of prepare_zoomlevel: the encoder may call this concurrently for different planes
 #ifdef SUPPORT_HDR
     if (image.getDepth() > 8) {
      switch(p) {
       case 0:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>,Plane<ColorVal_intern_16u>,true,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>,Plane<ColorVal_intern_16u>,false,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,true,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,false,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       case 1:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_32>,Plane<ColorVal_intern_16u>,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_32>,Plane<ColorVal_intern_16u>,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_32>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_32>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       case 2:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_32>,Plane<ColorVal_intern_16u>,true,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_32>,Plane<ColorVal_intern_16u>,false,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_32>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,true,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_32>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,false,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_32>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       case 3:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>,Plane<ColorVal_intern_16u>,true,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>,Plane<ColorVal_intern_16u>,false,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,true,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16u>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,false,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       default:
         assert(p==4);
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_16u>,true,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_16u>,false,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,true,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_16u>::ZoomView,false,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_16u>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
      }
     } else
 #endif
      switch(p) {
       case 0:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,true,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,false,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,true,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,false,false,0,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       case 1:
         if (image.getPlane(0).is_constant()) {
-          if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,ConstantPlane,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const ConstantPlane&>(image.getPlane(0)),z,r,c,min,max,predictor);
-          else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,ConstantPlane,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const ConstantPlane&>(image.getPlane(0)),z,r,c,min,max,predictor);
+          if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,ConstantPlane::ZoomView,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const ConstantPlane&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+          else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,ConstantPlane::ZoomView,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const ConstantPlane&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
         } else {
-          if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16>,Plane<ColorVal_intern_8>,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-          else return predict_and_calcProps_plane<Plane<ColorVal_intern_16>,Plane<ColorVal_intern_8>,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+          if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,true,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+          else return predict_and_calcProps_plane<Plane<ColorVal_intern_16>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,false,false,1,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
         }
       case 2:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16>,Plane<ColorVal_intern_8>,true,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16>,Plane<ColorVal_intern_8>,false,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_16>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,true,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_16>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,false,false,2,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_16>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       case 3:
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,true,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,false,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,true,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,false,false,3,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
       default:
         assert(p==4);
-        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,true,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
-        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>,Plane<ColorVal_intern_8>,false,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)),z,r,c,min,max,predictor);
+        if (z%2==0) return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,true,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
+        else return predict_and_calcProps_plane<Plane<ColorVal_intern_8>::ZoomView,Plane<ColorVal_intern_8>::ZoomView,false,false,4,ColorRanges>(properties,ranges,image,static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(p)).zoom_view(z),static_cast<const Plane<ColorVal_intern_8>&>(image.getPlane(0)).zoom_view(z),z,r,c,min,max,predictor);
      }
 }
 
@@ -213,3 +215,97 @@ std::pair<int, int> plane_zoomlevel(const Image &image, const int beginZL, const
 
     return std::pair<int, int>(p,zl);
 }
+
+void parallel_for(size_t n, int nb_threads, const std::function<void(size_t)> &job) {
+    if (nb_threads <= 0) nb_threads = std::thread::hardware_concurrency();
+    if (nb_threads > (int)n) nb_threads = n;
+    if (nb_threads <= 1) {
+        for (size_t i = 0; i < n; i++) job(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < n; i = next++) job(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nb_threads; t++) threads.emplace_back(worker);
+    worker();
+    for (std::thread &t : threads) t.join();
+}
+
+const char * const phase_names[NB_PHASES] = {"transform_process", "transform_data", "rough_pass", "learn", "tree", "final_pass",
+                                             "inv_data", "checksum"};
+bool phase_timing = false;
+std::atomic<int64_t> phase_nanoseconds[NB_PHASES];
+
+void reset_phase_timing() {
+    for (int i = 0; i < NB_PHASES; i++) phase_nanoseconds[i] = 0;
+}
+
+int FLIF_STATS::num_zoomlevels() const {
+    size_t n = 0;
+    for (const std::vector<int64_t> &b : bytes) n = std::max(n, b.size());
+    return n;
+}
+
+void FLIF_STATS::add_symbols(int p, int z, int64_t nb_bytes, int64_t nb_symbols, int64_t depth) {
+    if ((int)bytes.size() <= p) {
+        bytes.resize(p+1);
+        symbols.resize(p+1);
+        tree_depth.resize(p+1);
+    }
+    if ((int)bytes[p].size() <= z) {
+        bytes[p].resize(z+1);
+        symbols[p].resize(z+1);
+    }
+    bytes[p][z] += nb_bytes;
+    symbols[p][z] += nb_symbols;
+    tree_depth[p] += depth;
+}
+
+void FLIF_STATS::set_forest(const std::vector<Tree> &forest) {
+    tree_nodes.assign(forest.size(), 0);
+    tree_leaves.assign(forest.size(), 0);
+    for (size_t p = 0; p < forest.size(); p++) {
+        // walk the tree: after simplification, the encoder's tree still contains the nodes of pruned subtrees
+        std::vector<uint32_t> todo(1, 0);
+        while (!todo.empty()) {
+            const PropertyDecisionNode &n = forest[p][todo.back()];
+            todo.pop_back();
+            tree_nodes[p]++;
+            if (n.property == -1) tree_leaves[p]++;
+            else { todo.push_back(n.childID); todo.push_back(n.childID+1); }
+        }
+    }
+}
+
+void FLIF_STATS::update_memory(const Images &images) {
+    int64_t total = 0;
+    for (const Image &image : images) total += image.plane_memory();
+    peak_plane_memory = std::max(peak_plane_memory, total);
+}
+
+// combines the statistics of tiles: counts and times add up, the memory peak is the largest one of a single tile
+void FLIF_STATS::merge(const FLIF_STATS &other) {
+    for (int p = 0; p < other.num_planes(); p++)
+        for (size_t z = 0; z < other.bytes[p].size(); z++)
+            add_symbols(p, z, other.bytes[p][z], other.symbols[p][z], 0);
+    for (int p = 0; p < other.num_planes(); p++) tree_depth[p] += other.tree_depth[p];
+    if (tree_nodes.size() < other.tree_nodes.size()) {
+        tree_nodes.resize(other.tree_nodes.size());
+        tree_leaves.resize(other.tree_leaves.size());
+    }
+    for (size_t p = 0; p < other.tree_nodes.size(); p++) {
+        tree_nodes[p] += other.tree_nodes[p];
+        tree_leaves[p] += other.tree_leaves[p];
+    }
+    for (int i = 0; i < NB_PHASES; i++) phase_seconds[i] += other.phase_seconds[i];
+    peak_plane_memory = std::max(peak_plane_memory, other.peak_plane_memory);
+}
+
+std::shared_ptr<const DecoderArena::Table> DecoderArena::table(int cut, int alpha) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &t : tables) if (t.first == std::make_pair(cut, alpha)) return t.second;
+    tables.emplace_back(std::make_pair(cut, alpha), std::make_shared<Table>(cut, alpha));
+    return tables.back().second;
+}
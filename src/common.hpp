@@ -20,6 +20,11 @@ limitations under the License.
 
 #include <memory>
 #include <string>
+#include <functional>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string.h>
 
 #include "maniac/rac.hpp"
@@ -45,6 +50,17 @@ struct Progress
     bool reached_target() const { return quality() >= progressive_qual_target; }
 };
 
+// Offsets (relative to the start of the image data) up to which a decoder reads when it stops early
+// for a lower scale or quality, recorded by the encoder and stored in the optional "tRnc" chunk
+struct TruncationIndex
+{
+    long data_start = 0;
+    int64_t pixels_todo = 1;        // counted like the decoder's Progress (scale 1:1)
+    int64_t pixels_done = 0;
+    std::map<int, long> scales;     // 1:N scale -> offset
+    std::map<int, long> qualities;  // quality percentage -> offset
+};
+
 #define MAX_TRANSFORM 13
 #define MAX_PREDICTOR 2
 
@@ -92,8 +108,8 @@ template<typename I> I inline median3(I a, I b, I c) {
     }
 }
 
-template <typename plane_t, bool nobordercases>
-ColorVal predict_and_calcProps_scanlines_plane(Properties &properties, const ColorRanges *ranges, const Image &image, const plane_t &plane, const int p, const uint32_t r, const uint32_t c, ColorVal &min, ColorVal &max, const ColorVal fallback) {
+template <typename plane_t, bool nobordercases, typename ranges_t>
+ColorVal predict_and_calcProps_scanlines_plane(Properties &properties, const ranges_t *ranges, const Image &image, const plane_t &plane, const int p, const uint32_t r, const uint32_t c, ColorVal &min, ColorVal &max, const ColorVal fallback) {
     ColorVal guess;
     int which = 0;
     int index=0;
@@ -323,6 +339,75 @@ int plane_zoomlevels(const Image &image, const int beginZL, const int endZL);
 
 std::pair<int, int> plane_zoomlevel(const Image &image, const int beginZL, const int endZL, int i, const ColorRanges *ranges);
 
+// Call job(0) ... job(n-1), using up to nb_threads threads (0 = one per core).
+void parallel_for(size_t n, int nb_threads, const std::function<void(size_t)> &job);
+
+// Time spent in the main phases of encoding/decoding (summed over all threads), used by flif-bench.
+// Nothing is measured unless phase_timing is set.
+enum FlifPhase { PHASE_TRANSFORM_PROCESS, PHASE_TRANSFORM_DATA, PHASE_ROUGH_PASS, PHASE_LEARN, PHASE_TREE, PHASE_FINAL_PASS,
+                 PHASE_INV_DATA, PHASE_CHECKSUM, NB_PHASES };
+extern const char * const phase_names[NB_PHASES];
+extern bool phase_timing;
+extern std::atomic<int64_t> phase_nanoseconds[NB_PHASES];
+void reset_phase_timing();
+
+// Statistics of one encode or decode, returned by flif_decoder_get_stats / flif_encoder_get_stats.
+// Only filled in when flif_options::stats points to one, and only by the thread doing the encode/decode.
+struct FLIF_STATS {
+    std::vector<std::vector<int64_t>> bytes;    // [plane][zoomlevel] compressed bytes (non-interlaced: zoomlevel 0)
+    std::vector<std::vector<int64_t>> symbols;  // [plane][zoomlevel] MANIAC symbols
+    std::vector<int64_t> tree_nodes, tree_leaves, tree_depth;  // [plane], tree_depth = inner nodes visited by all symbols
+    double phase_seconds[NB_PHASES] = {};
+    int64_t peak_plane_memory = 0;
+
+    int num_planes() const { return bytes.size(); }
+    int num_zoomlevels() const;
+    void add_symbols(int p, int z, int64_t nb_bytes, int64_t nb_symbols, int64_t depth);
+    void set_forest(const std::vector<Tree> &forest);
+    void update_memory(const Images &images);
+    void merge(const FLIF_STATS &other);
+};
+
+class PhaseTimer {
+    const int phase;
+    FLIF_STATS *stats;
+    std::chrono::steady_clock::time_point start;
+public:
+    explicit PhaseTimer(int p, FLIF_STATS *s = NULL) : phase(phase_timing || s ? p : -1), stats(s) {
+        if (phase >= 0) start = std::chrono::steady_clock::now();
+    }
+    ~PhaseTimer() {
+        if (phase < 0) return;
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (phase_timing) phase_nanoseconds[phase] += ns;
+        if (stats) stats->phase_seconds[phase] += ns * 1e-9;
+    }
+};
+
+// Memory that a decoder keeps from one image to the next (see flif_options::arena): the pixel buffers of images that
+// are no longer used, the leaf nodes of the MANIAC coders and their bit chance tables. A decoder that goes through
+// many images of similar size then stops allocating (and page faulting) new buffers for each of them.
+struct DecoderArena {
+    typedef FLIFBitChancePass2::Table Table;
+    PlaneBuffers planes;
+    // the bit chance table for the given cutoff and alpha, built the first time it is asked for
+    std::shared_ptr<const Table> table(int cut, int alpha);
+    // the pool of leaf nodes of a FinalPropertySymbolCoder (Leaf is its leaf type)
+    template <typename Leaf> BufferPool<Leaf> &leaves();
+
+private:
+    std::mutex mutex;
+    std::vector<std::pair<std::pair<int, int>, std::shared_ptr<const Table>>> tables;
+    BufferPool<FinalCompoundSymbolChances<FLIFBitChancePass2, 10>> leaves_10;
+    BufferPool<FinalCompoundSymbolChances<FLIFBitChancePass2, 18>> leaves_18;
+};
+template <> inline BufferPool<FinalCompoundSymbolChances<FLIFBitChancePass2, 10>> &DecoderArena::leaves<FinalCompoundSymbolChances<FLIFBitChancePass2, 10>>() {
+    return leaves_10;
+}
+template <> inline BufferPool<FinalCompoundSymbolChances<FLIFBitChancePass2, 18>> &DecoderArena::leaves<FinalCompoundSymbolChances<FLIFBitChancePass2, 18>>() {
+    return leaves_18;
+}
+
 inline std::vector<ColorVal> computeGreys(const ColorRanges *ranges) {
     std::vector<ColorVal> greys; // a pixel with values in the middle of the bounds
     for (int p = 0; p < ranges->numPlanes(); p++) greys.push_back((ranges->min(p)+ranges->max(p))/2);
@@ -5,6 +5,7 @@
 /*****************************************/
 
 // define this flag if you want support for > 8 bit per channel
+// (8-bit images still get 8-bit planes and the 10-bit MANIAC coders, so this costs them nothing)
 #ifndef ONLY_8BIT
 #define SUPPORT_HDR 1
 #endif
@@ -32,6 +33,10 @@
 // refuse to decode something which claims to have more frames than this
 #define MAX_FRAMES 50000
 
+// interlaced images with at least this many pixels are decoded with the planes in zoomlevel-major order
+// (the coarse zoomlevels of a big image are too sparse in a raster layout to make good use of the caches)
+#define ZOOMLEVEL_STORAGE_MIN_PIXELS 4000000
+
 /************************/
 /* COMPILATION OPTIONS  */
 /************************/
@@ -63,6 +68,9 @@
 // more repeats makes encoding more expensive, but results in better trees (smaller files)
 #define TREE_LEARN_REPEATS 2
 
+// images above this many megapixels learn their trees from a sample of the rows; 0 = always use all rows
+#define TREE_LEARN_SAMPLE_MEGAPIXELS 4
+
 #define DEFAULT_MAX_PALETTE_SIZE 512
 
 // 8 byte improvement needed before splitting a MANIAC leaf node
@@ -97,6 +105,7 @@
 
 #include <vector>
 #include <stdint.h>
+#include <stddef.h>
 
 enum class Optional : uint8_t {
   undefined = 0
@@ -113,9 +122,14 @@ union flifEncodingOptional {
   flifEncodingOptional() : o(Optional::undefined) {}
 };
 
+struct FLIF_STATS;
+struct ForestDictionary;
+struct DecoderArena;
+
 struct flif_options {
 #ifdef HAS_ENCODER
     int learn_repeats;
+    int learn_sample;
     int acb;
     std::vector<int> frame_delay;
     int palette_size;
@@ -132,6 +146,9 @@ struct flif_options {
     int adaptive;
     int predictor[5];
     int chroma_subsampling;
+    int tile_size;
+    int truncation_index;
+    ForestDictionary *dictionary;
 #endif
     flifEncodingOptional method;
     int invisible_predictor;
@@ -145,16 +162,24 @@ struct flif_options {
     int resize_width;
     int resize_height;
     int fit;
+    int crop_x;
+    int crop_y;
+    int crop_width;
+    int crop_height;
     int overwrite;
     int just_add_loss;
     int show_breakpoints;
     int no_full_decode;
     int keep_palette;
+    int threads;
+    FLIF_STATS *stats;
+    DecoderArena *arena;
 };
 
 const struct flif_options FLIF_DEFAULT_OPTIONS = {
 #ifdef HAS_ENCODER
     -1, // learn_repeats
+    TREE_LEARN_SAMPLE_MEGAPIXELS, // learn_sample
     -1, // acb, try auto color buckets
     {100}, // frame_delay
     -1, // palette_size
@@ -171,6 +196,9 @@ const struct flif_options FLIF_DEFAULT_OPTIONS = {
     0, // adaptive
     {-2,-2,-2,-2,-2}, // predictor, heuristically pick a fixed predictor on all planes
     0, // chroma_subsampling
+    0, // tile_size, 0 = no tiles
+    0, // truncation_index
+    NULL, // dictionary, NULL = learn the MANIAC trees from scratch
 #endif
     flifEncodingOptional(), // method
     2, // invisible_predictor
@@ -184,9 +212,16 @@ const struct flif_options FLIF_DEFAULT_OPTIONS = {
     0, // resize_width
     0, // resize_height
     0, // fit
+    0, // crop_x
+    0, // crop_y
+    0, // crop_width, 0 = decode the whole image
+    0, // crop_height
     0, // overwrite
     0, // just_add_loss
     0, // show_breakpoints
     0, // no_full_decode
     0, // keep_palette
+    0, // threads, 0 = one per available core
+    NULL, // stats, NULL = don't collect statistics
+    NULL, // arena, NULL = every decode allocates its own buffers
 };
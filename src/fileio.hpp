@@ -20,6 +20,14 @@ limitations under the License.
 
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 class FileIO
 {
@@ -50,7 +58,11 @@ public:
       return ::ftell(file);
     }
     int get_c() {
+#ifdef _WIN32
       return fgetc(file);
+#else
+      return getc_unlocked(file); // a FileIO is only ever used from one thread
+#endif
     }
     char * gets(char *buf, int n) {
       return fgets(buf, n, file);
@@ -61,6 +73,9 @@ public:
     int fputc(int c) {
       return ::fputc(c, file);
     }
+    size_t fwrite(const uint8_t *buf, size_t n) {
+      return ::fwrite(buf, 1, n, file);
+    }
     void fseek(long offset, int where) {
       ::fseek(file, offset,where);
     }
@@ -79,14 +94,16 @@ private:
     size_t data_array_size;
     size_t seek_pos;
     bool readEOS;
+    const char *name;
 public:
     const int EOS = -1;
 
-    BlobReader(const uint8_t* _data, size_t _data_array_size)
+    BlobReader(const uint8_t* _data, size_t _data_array_size, const char *aname = "BlobReader")
     : data(_data)
     , data_array_size(_data_array_size)
     , seek_pos(0)
     , readEOS(false)
+    , name(aname)
     {
     }
 
@@ -139,8 +156,50 @@ public:
             break;
         }
     }
-    static const char* getName() {
-        return "BlobReader";
+    const char* getName() const {
+        return name;
+    }
+};
+
+/*!
+ * Read-only memory mapping of a file, from its current position to the end, to be decoded with a BlobReader instead
+ * of reading it byte by byte through stdio. data() is NULL if the file cannot be mapped (e.g. a pipe), in which case
+ * FileIO has to be used.
+ */
+class FileMapping
+{
+private:
+    void *map;
+    size_t length;
+    size_t offset;
+public:
+    FileMapping(const FileMapping&) = delete;
+    void operator=(const FileMapping&) = delete;
+
+    explicit FileMapping(FILE *file) : map(NULL), length(0), offset(0) {
+#ifndef _WIN32
+        struct stat st;
+        int fd = fileno(file);
+        long pos = ::ftell(file);
+        if (pos < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= pos) return;
+        void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) return;
+        madvise(m, st.st_size, MADV_SEQUENTIAL);
+        map = m;
+        length = st.st_size;
+        offset = pos;
+#endif
+    }
+    ~FileMapping() {
+#ifndef _WIN32
+        if (map) munmap(map, length);
+#endif
+    }
+    const uint8_t* data() const {
+        return map ? static_cast<const uint8_t*>(map) + offset : NULL;
+    }
+    size_t size() const {
+        return length - offset;
     }
 };
 
@@ -161,7 +220,7 @@ private:
 
     void grow(size_t necessary_size) {
         readEOS = false;
-        if(necessary_size < data_array_size)
+        if(necessary_size <= data_array_size)
             return;
 
         size_t new_size = necessary_size;
@@ -245,25 +304,29 @@ public:
         }
     }
     int fputs(const char *s) {
-        size_t i = 0;
-        // null-terminated string
-        while(s[i])
-        {
-            grow(seek_pos + 1);
-            data[seek_pos++] = s[i++];
-            if(bytes_used < seek_pos)
-                bytes_used = seek_pos+1;
-        }
+        fwrite(reinterpret_cast<const uint8_t*>(s), strlen(s));
         return 0;
     }
     int fputc(int c) {
-        grow(seek_pos + 1);
+        // grow() only when the array is full; it grows by half, so that is rare
+        if(seek_pos >= data_array_size)
+            grow(seek_pos + 1);
 
         data[seek_pos++] = static_cast<uint8_t>(c);
         if(bytes_used < seek_pos)
-            bytes_used = seek_pos+1;
+            bytes_used = seek_pos;
         return c;
     }
+    size_t fwrite(const uint8_t *buf, size_t n) {
+        if(seek_pos + n > data_array_size)
+            grow(seek_pos + n);
+        readEOS = false;
+        memcpy(data + seek_pos, buf, n);
+        seek_pos += n;
+        if(bytes_used < seek_pos)
+            bytes_used = seek_pos;
+        return n;
+    }
     void fseek(long offset, int where) {
         readEOS = false;
         switch(where) {
@@ -283,3 +346,196 @@ public:
     }
 };
 
+/*!
+ * Write-only IO interface that passes the output on to a callback in blocks of up to block_size bytes, in order,
+ * so the encoded file is never held in memory as a whole. There is no seeking back.
+ * After the callback has returned false, all further output is dropped and ok() is false.
+ */
+class SinkIO
+{
+private:
+    std::function<bool(const uint8_t*, size_t)> sink;
+    std::vector<uint8_t> buffer;
+    size_t used;
+    size_t written;  // bytes already passed on to the sink
+    bool failed;
+
+    void drain() {
+        if (used && !failed) failed = !sink(buffer.data(), used);
+        written += used;
+        used = 0;
+    }
+public:
+    const int EOS = -1;
+
+    explicit SinkIO(std::function<bool(const uint8_t*, size_t)> asink, size_t block_size = 1 << 16)
+    : sink(asink), buffer(block_size ? block_size : 1), used(0), written(0), failed(false) { }
+
+    SinkIO(const SinkIO&) = delete;
+    void operator=(const SinkIO&) = delete;
+
+    bool ok() const {
+        return !failed;
+    }
+    void flush() {
+        drain();
+    }
+    bool isEOF() const {
+        return false;
+    }
+    long ftell() const {
+        return written + used;
+    }
+    int get_c() {
+        return EOS;
+    }
+    char * gets(char *FLIF_UNUSED(buf), int FLIF_UNUSED(n)) {
+        return 0;
+    }
+    int fputs(const char *s) {
+        fwrite(reinterpret_cast<const uint8_t*>(s), strlen(s));
+        return 0;
+    }
+    int fputc(int c) {
+        if (used == buffer.size()) drain();
+        buffer[used++] = static_cast<uint8_t>(c);
+        return c;
+    }
+    size_t fwrite(const uint8_t *buf, size_t n) {
+        if (used + n <= buffer.size()) {
+            memcpy(buffer.data() + used, buf, n);
+            used += n;
+            return n;
+        }
+        // big writes go to the sink directly instead of through the buffer
+        drain();
+        if (!failed) failed = !sink(buf, n);
+        written += n;
+        return n;
+    }
+    static const char* getName() {
+        return "SinkIO";
+    }
+};
+
+/*!
+ * Read-only IO interface for data that arrives in chunks (incremental decoding).
+ * The reading thread blocks when it runs out of data, until more is pushed or the stream is closed.
+ */
+class StreamReader
+{
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::vector<uint8_t>> chunks;  // chunks keep their heap buffers when this vector grows
+    bool closed;
+    bool starved;       // reader is waiting for data that has not been pushed yet
+    bool finished;      // reader is done and will not read anymore
+    // only used by the reading thread
+    size_t next_chunk;
+    const uint8_t* data;
+    size_t data_size;
+    size_t data_pos;
+    size_t seek_pos;
+    bool readEOS;
+
+    bool fetch() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next_chunk >= chunks.size() && !closed) {
+            starved = true;
+            cv.notify_all();
+            cv.wait(lock);
+        }
+        starved = false;
+        if (next_chunk >= chunks.size()) return false;
+        data = chunks[next_chunk].data();
+        data_size = chunks[next_chunk].size();
+        data_pos = 0;
+        next_chunk++;
+        return true;
+    }
+    void rewind() {
+        next_chunk = 0;
+        data = NULL;
+        data_size = data_pos = seek_pos = 0;
+    }
+public:
+    const int EOS = -1;
+
+    StreamReader() : closed(false), starved(false), finished(false), readEOS(false) { rewind(); }
+
+    // called by the producer
+    void push(const uint8_t* buf, size_t len) {
+        if (!len) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks.emplace_back(buf, buf + len);
+        cv.notify_all();
+    }
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        cv.notify_all();
+    }
+    // block until the reader has consumed everything pushed so far, or has finished
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!finished && !(starved && next_chunk >= chunks.size())) cv.wait(lock);
+    }
+    // called by the reader when it stops reading
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        cv.notify_all();
+    }
+    bool has_finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished;
+    }
+
+    bool isEOF() const {
+        return readEOS;
+    }
+    long ftell() const {
+        return seek_pos;
+    }
+    int get_c() {
+        while (data_pos >= data_size) {
+            if (!fetch()) {
+                readEOS = true;
+                return EOS;
+            }
+        }
+        seek_pos++;
+        return data[data_pos++];
+    }
+    char * gets(char *buf, int n) {
+        int i = 0;
+        const int max_write = n-1;
+        int c = 0;
+        while(i < max_write && (c = get_c()) != EOS)
+            buf[i++] = c;
+        buf[n-1] = '\0';
+
+        if(i < max_write) {
+            return 0;
+        } else {
+            return buf;
+        }
+    }
+    int fputc(int FLIF_UNUSED(c)) {
+      return EOS;
+    }
+    // only forward seeks are cheap: the data before the current position is kept, but has to be skipped again
+    void fseek(long offset, int where) {
+        readEOS = false;
+        long target = offset;
+        if (where == SEEK_CUR) target += seek_pos;
+        else if (where != SEEK_SET) return; // the end of the stream is not known yet
+        if (target < (long)seek_pos) rewind();
+        while ((long)seek_pos < target && get_c() != EOS) {}
+    }
+    static const char* getName() {
+        return "StreamReader";
+    }
+};
+
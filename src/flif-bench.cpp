@@ -0,0 +1,210 @@
+/*
+ FLIF - Free Lossless Image Format
+ Copyright (C) 2010-2016  Jon Sneyers & Pieter Wuille, LGPL v3+
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// flif-bench: encode and decode every image of a corpus a number of times and report the timings as JSON,
+// so two builds can be compared with a plain diff.
+//
+//   flif-bench [-r REPEATS] [-w WARMUP] [-j THREADS] [-R LEARN_REPEATS] [-a SAMPLE_MP] [-N] [-Q QUALITY] [-o OUT.json] [FILE|DIR]...
+//
+// Directories are scanned for .png/.pnm/.ppm/.pgm/.pam files; the default corpus is ../testFiles and ../tools.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <strings.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "common.hpp"
+#include "fileio.hpp"
+#include "flif-enc.hpp"
+#include "flif-dec.hpp"
+#include "transform/rowkernels.hpp"
+
+struct RunTimes {
+    std::vector<double> seconds;
+    double phases[NB_PHASES] = {};
+};
+
+static double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[v.size()/2];
+}
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static bool is_image_file(const std::string &name) {
+    const char *ext = strrchr(name.c_str(), '.');
+    return ext && (!strcasecmp(ext,".png") || !strcasecmp(ext,".pnm") || !strcasecmp(ext,".ppm")
+                   || !strcasecmp(ext,".pgm") || !strcasecmp(ext,".pam"));
+}
+
+static void add_corpus(const char *path, std::vector<std::string> &files) {
+    struct stat st;
+    if (stat(path, &st)) { e_printf("Warning: skipping %s (does not exist)\n", path); return; }
+    if (!S_ISDIR(st.st_mode)) { files.push_back(path); return; }
+    DIR *dir = opendir(path);
+    if (!dir) return;
+    std::vector<std::string> found;
+    while (struct dirent *entry = readdir(dir)) {
+        if (is_image_file(entry->d_name)) found.push_back(std::string(path) + "/" + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+static std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+template <typename F>
+static void measure(int warmup, int repeats, RunTimes &times, F run) {
+    for (int i = 0; i < warmup + repeats; i++) {
+        reset_phase_timing();
+        double seconds = run();
+        if (i < warmup) continue;
+        times.seconds.push_back(seconds);
+        for (int p = 0; p < NB_PHASES; p++) times.phases[p] += phase_nanoseconds[p] * 1e-9 / repeats;
+    }
+}
+
+static void print_times(FILE *out, const char *name, const RunTimes &times, double megapixels, bool last) {
+    const double seconds = median(times.seconds);
+    fprintf(out, "      \"%s\": {\"seconds\": %.6f, \"seconds_min\": %.6f, \"mp_per_s\": %.3f, \"phases\": {",
+            name, seconds, *std::min_element(times.seconds.begin(), times.seconds.end()), seconds > 0 ? megapixels / seconds : 0);
+    for (int p = 0; p < NB_PHASES; p++) fprintf(out, "%s\"%s\": %.6f", (p ? ", " : ""), phase_names[p], times.phases[p]);
+    fprintf(out, "}}%s\n", last ? "" : ",");
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    flif_options options = FLIF_DEFAULT_OPTIONS;
+    int repeats = 3, warmup = 1;
+    const char *outname = NULL;
+    ForestDictionary dictionary;
+    int c;
+    while ((c = getopt(argc, argv, "hr:w:j:R:a:NQ:l:o:")) != -1) {
+        switch (c) {
+        case 'r': repeats = atoi(optarg); if (repeats < 1) {e_printf("Not a sensible number for option -r\n"); return 1;} break;
+        case 'w': warmup = atoi(optarg); if (warmup < 0) {e_printf("Not a sensible number for option -w\n"); return 1;} break;
+        case 'j': options.threads = atoi(optarg); break;
+        case 'R': options.learn_repeats = atoi(optarg); break;
+        case 'a': options.learn_sample = atoi(optarg); break;
+        case 'N': options.method.encoding = flifEncoding::nonInterlaced; break;
+        case 'Q': options.loss = 100 - atoi(optarg); if (options.loss < 0) {e_printf("Not a sensible number for option -Q\n"); return 1;} break;
+        case 'l': if (!dictionary.load(optarg)) return 1;
+                  options.dictionary = &dictionary;
+                  break;
+        case 'o': outname = optarg; break;
+        default:
+            e_printf("Usage: flif-bench [-r REPEATS] [-w WARMUP] [-j THREADS] [-R LEARN_REPEATS] [-N] [-Q QUALITY] [-l DICTIONARY] [-o OUT.json] [FILE|DIR]...\n");
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    std::vector<std::string> files;
+    if (optind == argc) {
+        add_corpus("../testFiles", files);
+        add_corpus("../tools", files);
+    }
+    for (int i = optind; i < argc; i++) add_corpus(argv[i], files);
+    if (files.empty()) { e_printf("No input images found.\n"); return 1; }
+
+    FILE *out = outname ? fopen(outname, "w") : stdout;
+    if (!out) { e_printf("Could not open output file: %s\n", outname); return 1; }
+
+    phase_timing = true;
+    metadata_options md = {true, true, true};
+    fprintf(out, "{\n  \"repeats\": %i,\n  \"warmup\": %i,\n  \"threads\": %i,\n  \"row_kernels\": \"%s\",\n  \"files\": [\n",
+            repeats, warmup, options.threads, row_kernels().name);
+    bool first = true;
+    int errors = 0;
+    for (const std::string &file : files) {
+        Images images;
+        {
+            Image image;
+            if (!image.load(file.c_str(), md) || image.numPlanes() == 0) { e_printf("Could not read input file: %s\n", file.c_str()); errors++; continue; }
+            images.push_back(std::move(image));
+        }
+        const double megapixels = (double)images[0].cols() * images[0].rows() / 1e6;
+
+        std::vector<uint8_t> encoded;
+        RunTimes encode_times, decode_times;
+        bool ok = true;
+        measure(warmup, repeats, encode_times, [&]() {
+            Images copy;
+            for (const Image &image : images) copy.push_back(image.clone());
+            flif_options encode_options = options;
+            std::vector<std::string> desc = choose_transforms(copy, encode_options);
+            BlobIO io;
+            auto start = std::chrono::steady_clock::now();
+            if (!flif_encode(io, copy, desc, encode_options)) ok = false;
+            double seconds = elapsed(start);
+            const size_t length = io.ftell();
+            size_t size;
+            uint8_t *data = io.release(&size);
+            encoded.assign(data, data + length);
+            delete [] data;
+            return seconds;
+        });
+        if (!ok) { e_printf("Could not encode %s\n", file.c_str()); errors++; continue; }
+        measure(warmup, repeats, decode_times, [&]() {
+            Images decoded;
+            flif_options decode_options = FLIF_DEFAULT_OPTIONS;
+            decode_options.threads = options.threads;
+            BlobReader reader(encoded.data(), encoded.size());
+            auto start = std::chrono::steady_clock::now();
+            if (!flif_decode(reader, decoded, decode_options, md)) ok = false;
+            return elapsed(start);
+        });
+        if (!ok) { e_printf("Could not decode %s\n", file.c_str()); errors++; continue; }
+
+        if (!first) fprintf(out, ",\n");
+        first = false;
+        fprintf(out, "    {\n      \"file\": %s,\n      \"width\": %lu,\n      \"height\": %lu,\n      \"channels\": %i,\n"
+                     "      \"bytes\": %lu,\n      \"bpp\": %.4f,\n      \"peak_rss_kb\": %li,\n",
+                json_string(file).c_str(), (unsigned long)images[0].cols(), (unsigned long)images[0].rows(), images[0].numPlanes(),
+                (unsigned long)encoded.size(), 8.0 * encoded.size() / images[0].cols() / images[0].rows(), peak_rss_kb());
+        print_times(out, "encode", encode_times, megapixels, false);
+        print_times(out, "decode", decode_times, megapixels, true);
+        fprintf(out, "    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+    return errors ? 2 : 0;
+}
@@ -19,6 +19,7 @@ limitations under the License.
 #include <string>
 #include <string.h>
 #include <functional>
+#include <mutex>
 
 #include "maniac/rac.hpp"
 #include "maniac/compound.hpp"
@@ -29,6 +30,7 @@ limitations under the License.
 
 #include "transform/colorbuckets.hpp"
 #include "transform/bounds.hpp"
+#include "transform/ycocg.hpp"
 
 #include "flif_config.h"
 
@@ -39,6 +41,14 @@ limitations under the License.
 
 using namespace maniac::util;
 
+FLIF_INFO::FLIF_INFO()
+: width(0)
+, height(0)
+, channels(0)
+, bit_depth(0)
+, num_images(0)
+{ }
+
 template<typename RAC> std::string static read_name(RAC& rac, int &nb) {
     UniformSymbolCoder<RAC> coder(rac);
     nb = coder.read_int(0, MAX_TRANSFORM);
@@ -46,8 +56,8 @@ template<typename RAC> std::string static read_name(RAC& rac, int &nb) {
     return transforms[nb];
 }
 
-template<typename Coder, typename plane_t, typename alpha_t>
-void flif_decode_scanline_plane(plane_t &plane, Coder &coder, Images &images, const ColorRanges *ranges, alpha_t &alpha, Properties &properties, 
+template<typename Coder, typename plane_t, typename alpha_t, typename ranges_t>
+void flif_decode_scanline_plane(plane_t &plane, Coder &coder, Images &images, const ranges_t *ranges, alpha_t &alpha, Properties &properties, 
                                 const int p, const int fr, const uint32_t r, const ColorVal grey, const ColorVal minP, const bool alphazero, const bool FRA) {
     ColorVal min,max;
     Image& image = images[fr];
@@ -129,10 +139,10 @@ void flif_decode_scanline_plane(plane_t &plane, Coder &coder, Images &images, co
 }
 
 //TODO use tuples or something to make this less ugly/more generic
-template<typename Coder, typename alpha_t>
+template<typename Coder, typename alpha_t, typename ranges_t>
 struct scanline_plane_decoder: public PlaneVisitor {
-    Coder &coder; Images &images; const ColorRanges *ranges; Properties &properties; const alpha_t &alpha; const int p, fr; const uint32_t r; const ColorVal grey, minP; const bool alphazero, FRA;
-    scanline_plane_decoder(Coder &c, Images &i, const ColorRanges *ra, Properties &prop, const GeneralPlane &al, const int pl, const int f, const uint32_t row, const ColorVal g, const ColorVal m, const bool az, const bool fra) :
+    Coder &coder; Images &images; const ranges_t *ranges; Properties &properties; const alpha_t &alpha; const int p, fr; const uint32_t r; const ColorVal grey, minP; const bool alphazero, FRA;
+    scanline_plane_decoder(Coder &c, Images &i, const ranges_t *ra, Properties &prop, const GeneralPlane &al, const int pl, const int f, const uint32_t row, const ColorVal g, const ColorVal m, const bool az, const bool fra) :
         coder(c), images(i), ranges(ra), properties(prop), alpha(static_cast<const alpha_t&>(al)), p(pl), fr(f), r(row), grey(g), minP(m), alphazero(az), FRA(fra) {}
 
     void visit(Plane<ColorVal_intern_8>   &plane) override {flif_decode_scanline_plane(plane,coder,images,ranges,alpha,properties,p,fr,r,grey,minP,alphazero,FRA);}
@@ -166,8 +176,8 @@ void downsample(const int width, const int height, int target_w, int target_h, I
 
 
 
-template<typename IO, typename Rac, typename Coder>
-bool flif_decode_scanlines_inner(IO &io, FLIF_UNUSED(Rac &rac), std::vector<Coder> &coders, Images &images, const ColorRanges *ranges, flif_options &options,
+template<typename IO, typename Rac, typename Coder, typename ranges_t>
+bool flif_decode_scanlines_inner(IO &io, FLIF_UNUSED(Rac &rac), std::vector<Coder> &coders, Images &images, const ranges_t *ranges, flif_options &options,
                                  std::vector<Transform<IO>*> &transforms, callback_t callback, void *user_data, Images &partial_images, Progress &progress) {
     const int nump = images[0].numPlanes();
     const bool alphazero = images[0].alpha_zero_special;
@@ -202,6 +212,8 @@ bool flif_decode_scanlines_inner(IO &io, FLIF_UNUSED(Rac &rac), std::vector<Code
           v_printf_tty(2,"\r%i%% done [%i/%i] DEC[%ux%u]    ",(int)(100*progress.pixels_done/progress.pixels_todo),i,nump,images[0].cols(),images[0].rows());
           v_printf_tty(4,"\n");
           progress.pixels_done += images[0].cols()*images[0].rows();
+          const long start_pos = io.ftell();
+          const uint64_t start_symbols = coders[p].symbols(), start_visited = coders[p].visited_nodes();
           for (uint32_t r = 0; r < images[0].rows(); r++) {
             if (images[0].cols() == 0) return false; // decode aborted
             for (int fr=0; fr< (int)images.size(); fr++) {
@@ -210,19 +222,20 @@ bool flif_decode_scanlines_inner(IO &io, FLIF_UNUSED(Rac &rac), std::vector<Code
                 ConstantPlane null_alpha(1);
                 GeneralPlane &alpha = nump > 3 ? image.getPlane(3) : null_alpha;
                 if (alpha.is_constant()) {
-                    scanline_plane_decoder<Coder,ConstantPlane> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
+                    scanline_plane_decoder<Coder,ConstantPlane,ranges_t> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
                     plane.accept_visitor(decoder);
                 } else if (image.getDepth() <= 8) {
-                    scanline_plane_decoder<Coder,Plane<ColorVal_intern_8>> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
+                    scanline_plane_decoder<Coder,Plane<ColorVal_intern_8>,ranges_t> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
                     plane.accept_visitor(decoder);
 #ifdef SUPPORT_HDR
                 } else {
-                    scanline_plane_decoder<Coder,Plane<ColorVal_intern_16u>> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
+                    scanline_plane_decoder<Coder,Plane<ColorVal_intern_16u>,ranges_t> decoder(coders[p],images,ranges,properties,alpha,p,fr,r,greys[p],minP,alphazero,FRA);
                     plane.accept_visitor(decoder);
 #endif
                 }
             }
           }
+          if (options.stats) options.stats->add_symbols(p, 0, io.ftell() - start_pos, coders[p].symbols() - start_symbols, coders[p].visited_nodes() - start_visited);
           int qual = progress.quality();
           if (callback && p != 4 && qual >= progress.progressive_qual_target) {
             auto populatePartialImages = [&] () {
@@ -241,6 +254,20 @@ bool flif_decode_scanlines_inner(IO &io, FLIF_UNUSED(Rac &rac), std::vector<Code
     return true;
 }
 
+// with an arena, the coders share its bit chance table and take their leaf nodes from it
+template<typename Coder, typename Rac>
+void add_coder(std::vector<Coder> &coders, Rac &rac, Ranges &propRanges, Tree &tree, const flif_options &options) {
+    if (options.arena)
+        coders.emplace_back(rac, propRanges, tree, 0, options.cutoff, options.alpha,
+                            options.arena->table(options.cutoff, options.alpha), &options.arena->leaves<typename Coder::Leaf>());
+    else
+        coders.emplace_back(rac, propRanges, tree, 0, options.cutoff, options.alpha);
+}
+
+PlaneBuffers *plane_buffers(const flif_options &options) {
+    return options.arena ? &options.arena->planes : NULL;
+}
+
 template<typename IO, typename Rac, typename Coder>
 bool flif_decode_scanlines_pass(IO& io, Rac &rac, Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, flif_options &options,
                                 std::vector<Transform<IO>*> &transforms, callback_t callback, void *user_data, Images &partial_images, Progress &progress) {
@@ -249,9 +276,20 @@ bool flif_decode_scanlines_pass(IO& io, Rac &rac, Images &images, const ColorRan
     for (int p = 0; p < images[0].numPlanes(); p++) {
         Ranges propRanges;
         initPropRanges_scanlines(propRanges, *ranges, p);
-        coders.emplace_back(rac, propRanges, forest[p], 0, options.cutoff, options.alpha);
+        add_coder(coders, rac, propRanges, forest[p], options);
     }
-    return flif_decode_scanlines_inner<IO,Rac,Coder>(io, rac, coders, images, ranges, options, transforms, callback, user_data, partial_images, progress);
+#if LARGE_BINARY > 0
+    // de-virtualize the most common ColorRanges, so snap() can be inlined in the pixel loops
+    if (const ColorRangesBounds * rangesB = dynamic_cast<const ColorRangesBounds*>(ranges)) {
+        if (const ColorRangesYCoCg * rangesYCoCg = dynamic_cast<const ColorRangesYCoCg*>(rangesB->getRanges())) {
+            const ColorRangesBoundsOf<ColorRangesYCoCg> rangesBY(rangesB->getBounds(), rangesYCoCg);
+            return flif_decode_scanlines_inner<IO,Rac,Coder,ColorRangesBoundsOf<ColorRangesYCoCg>>(io, rac, coders, images, &rangesBY, options, transforms, callback, user_data, partial_images, progress);
+        }
+    }
+    if (const ColorRangesCB * rangesCB = dynamic_cast<const ColorRangesCB*>(ranges))
+        return flif_decode_scanlines_inner<IO,Rac,Coder,ColorRangesCB>(io, rac, coders, images, rangesCB, options, transforms, callback, user_data, partial_images, progress);
+#endif
+    return flif_decode_scanlines_inner<IO,Rac,Coder,ColorRanges>(io, rac, coders, images, ranges, options, transforms, callback, user_data, partial_images, progress);
 }
 
 template<typename IO>
@@ -270,11 +308,54 @@ const ColorRanges * undo_palette(Images &images, const int scale, std::vector<Tr
     return ranges;
 }
 
+// The part of the image that will be kept (see flif_options::crop_x etc.), in pixels at scale 1:1.
+// Interpolating a zoomlevel only looks at the nearest known pixels of its grid, so the interpolation only has to fill
+// the window plus a margin of two grid pixels: that margin covers what the next (finer) zoomlevel looks at.
+struct CropWindow {
+    uint32_t x0, y0, x1, y1;    // columns x0..x1-1 of rows y0..y1-1
+
+    explicit CropWindow(const Image &image) : x0(0), y0(0), x1(image.cols()), y1(image.rows()) {}
+    CropWindow(const flif_options &options, const Image &image) : CropWindow(image) {
+        if (options.crop_width <= 0) return;
+        x0 = options.crop_x; x1 = x0 + options.crop_width;
+        y0 = options.crop_y; y1 = y0 + options.crop_height;
+    }
+    // the rows and columns of the zoomlevel z grid that have to be interpolated
+    uint32_t row_begin(const int z) const { const uint32_t r = y0 >> ((z+1)/2); return r > 2 ? r - 2 : 0; }
+    uint32_t row_end(const int z, const uint32_t rows) const { return std::min(rows, ((y1-1) >> ((z+1)/2)) + 3); }
+    uint32_t col_begin(const int z) const { const uint32_t c = x0 >> (z/2); return c > 2 ? c - 2 : 0; }
+    uint32_t col_end(const int z, const uint32_t cols) const { return std::min(cols, ((x1-1) >> (z/2)) + 3); }
+};
+
+// checks the crop window of the options against the image
+bool crop_window_fits(const flif_options &options, const int width, const int height, const int numFrames) {
+    if (options.crop_width <= 0) return true;
+    if (options.crop_x < 0 || options.crop_y < 0 || options.crop_height <= 0
+        || (int64_t)options.crop_x + options.crop_width > width || (int64_t)options.crop_y + options.crop_height > height) {
+        e_printf("Crop window %ix%i+%i+%i does not fit in the %ix%i image\n", options.crop_width, options.crop_height, options.crop_x, options.crop_y, width, height);
+        return false;
+    }
+    if (numFrames > 1) { e_printf("Cannot crop an animation\n"); return false; }
+    if (options.resize_width || options.resize_height) { e_printf("Don't use a crop window and (-r or -f) at the same time!\n"); return false; }
+    return true;
+}
+
+// the pixels of an image decoded at scale 1:2^scale_shift that cover the crop window
+void crop_window_scaled(const flif_options &options, const int scale_shift, uint32_t &x0, uint32_t &y0, uint32_t &x1, uint32_t &y1) {
+    x0 = options.crop_x >> scale_shift;
+    y0 = options.crop_y >> scale_shift;
+    x1 = ((options.crop_x + options.crop_width - 1) >> scale_shift) + 1;
+    y1 = ((options.crop_y + options.crop_height - 1) >> scale_shift) + 1;
+}
+
 // interpolate rest of the image
 // used when decoding lossy
 template<typename IO>
 void flif_decode_FLIF2_inner_interpol(Images &images, const ColorRanges *ranges, const int P,
-                                      const int endZL, const int32_t R, const int scale, std::vector<int> &zoomlevels, std::vector<Transform<IO>*> &transforms) {
+                                      const int endZL, const int32_t R, const int scale, std::vector<int> &zoomlevels, std::vector<Transform<IO>*> &transforms,
+                                      const CropWindow *crop = NULL) {
+    const CropWindow window = (crop ? *crop : CropWindow(images[0]));
+    for (Image& image : images) image.restore_raster_layout();
 
     // finish the zoomlevel we were working on
     if (R>=0) {
@@ -335,8 +416,9 @@ void flif_decode_FLIF2_inner_interpol(Images &images, const ColorRanges *ranges,
           GeneralPlane& plane = image.getPlane(p);
           uint32_t rows = image.rows(z);
           uint32_t cols = image.cols(z);
-          for (uint32_t r = 1; r < rows; r += 2) {
-             for (uint32_t c = 0; c < cols; c++) {
+          const uint32_t c_begin = window.col_begin(z), c_end = window.col_end(z, cols);
+          for (uint32_t r = window.row_begin(z) | 1; r < window.row_end(z, rows); r += 2) {
+             for (uint32_t c = c_begin; c < c_end; c++) {
                plane.set(z,r,c, predict_plane_horizontal(plane,z,p,r,c,rows,0));
              }
           }
@@ -347,8 +429,9 @@ void flif_decode_FLIF2_inner_interpol(Images &images, const ColorRanges *ranges,
           GeneralPlane& plane = image.getPlane(p);
           uint32_t rows = image.rows(z);
           uint32_t cols = image.cols(z);
-          for (uint32_t r = 0; r < rows; r++) {
-            for (uint32_t c = 1; c < cols; c += 2) {
+          const uint32_t c_begin = window.col_begin(z) | 1, c_end = window.col_end(z, cols);
+          for (uint32_t r = window.row_begin(z); r < window.row_end(z, rows); r++) {
+            for (uint32_t c = c_begin; c < c_end; c += 2) {
               plane.set(z,r,c, predict_plane_vertical(plane,z,p,r,c,cols,0));
             }
           }
@@ -680,6 +763,7 @@ bool flif_decode_FLIF2_inner(IO& io, Rac &rac, std::vector<Coder> &coders, Image
                              callback_t callback, void *user_data, Images &partial_images, Progress &progress) {
     const int nump = images[0].numPlanes();
     int quality=options.quality, scale=options.scale;
+    const CropWindow window(options, images[0]);
 //    const bool alphazero = images[0].alpha_zero_special;
 //    const bool FRA = (nump == 5);
     // flif_decode
@@ -712,7 +796,7 @@ bool flif_decode_FLIF2_inner(IO& io, Rac &rac, std::vector<Coder> &coders, Image
       if (z < 0) {e_printf("Corrupt file: invalid plane/zoomlevel\n"); return false;}
       if (100*progress.pixels_done > quality*progress.pixels_todo && endZL==0) {
               v_printf(5,"%lu subpixels done, %lu subpixels todo, quality target %i%% reached (%i%%)\n",(long unsigned)progress.pixels_done,(long unsigned)progress.pixels_todo,(int)quality,(int)(100*progress.pixels_done/progress.pixels_todo));
-              flif_decode_FLIF2_inner_interpol(images, ranges, p, endZL, -1, scale, zoomlevels, transforms);
+              flif_decode_FLIF2_inner_interpol(images, ranges, p, endZL, -1, scale, zoomlevels, transforms, &window);
               return false;
       }
       if (ranges->min(p) < ranges->max(p)) {
@@ -727,28 +811,33 @@ bool flif_decode_FLIF2_inner(IO& io, Rac &rac, std::vector<Coder> &coders, Image
         }
         if (1<<(z/2) < scale) {
               v_printf(5,"%lu subpixels done (out of %lu subpixels at this scale), scale target 1:%i reached\n",(long unsigned)progress.pixels_done,(long unsigned)progress.pixels_todo,scale);
-              flif_decode_FLIF2_inner_interpol(images, ranges, p, endZL, -1, scale, zoomlevels, transforms);
+              flif_decode_FLIF2_inner_interpol(images, ranges, p, endZL, -1, scale, zoomlevels, transforms, &window);
               return false;
         }
         v_printf_tty((endZL==0?2:10),"\r%i%% done [%i/%i] DEC[%i,%ux%u]  ",(int)(100*progress.pixels_done/progress.pixels_todo),i,plane_zoomlevels(images[0], beginZL, endZL)-1,p,images[0].cols(z),images[0].rows(z));
-        for (Image& image : images) { image.getPlane(p).prepare_zoomlevel(z); }
-        if (p>0) for (Image& image : images) { image.getPlane(0).prepare_zoomlevel(z); }
-        if (p<3 && nump>3) for (Image& image : images) { image.getPlane(3).prepare_zoomlevel(z); }
+        for (Image& image : images) { image.getPlane(p).refine_zoomlevels(z); image.getPlane(p).prepare_zoomlevel(z); }
+        if (p>0) for (Image& image : images) { image.getPlane(0).refine_zoomlevels(z); image.getPlane(0).prepare_zoomlevel(z); }
+        if (p<3 && nump>3) for (Image& image : images) { image.getPlane(3).refine_zoomlevels(z); image.getPlane(3).prepare_zoomlevel(z); }
 
 //        ConstantPlane null_alpha(1);
 //        GeneralPlane &alpha = nump > 3 ? images[0].getPlane(3) : null_alpha;
+        const long start_pos = io.ftell();
+        const uint64_t start_symbols = coders[p].symbols(), start_visited = coders[p].visited_nodes();
+        bool ok = true;
         if (z % 2 == 0) {
-                if (images[0].getDepth() <= 8) { if (!flif_decode_FLIF2_inner_horizontal<IO,Rac,Coder,Plane<ColorVal_intern_8>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress)) return false;}
+                if (images[0].getDepth() <= 8) ok = flif_decode_FLIF2_inner_horizontal<IO,Rac,Coder,Plane<ColorVal_intern_8>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress);
 #ifdef SUPPORT_HDR
-                else if (images[0].getDepth() > 8) { if (!flif_decode_FLIF2_inner_horizontal<IO,Rac,Coder,Plane<ColorVal_intern_16u>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress)) return false; }
+                else if (images[0].getDepth() > 8) ok = flif_decode_FLIF2_inner_horizontal<IO,Rac,Coder,Plane<ColorVal_intern_16u>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress);
 #endif
         } else {
-                if (images[0].getDepth() <= 8) { if (!flif_decode_FLIF2_inner_vertical<IO,Rac,Coder,Plane<ColorVal_intern_8>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress)) return false;}
+                if (images[0].getDepth() <= 8) ok = flif_decode_FLIF2_inner_vertical<IO,Rac,Coder,Plane<ColorVal_intern_8>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress);
 #ifdef SUPPORT_HDR
-                else if (images[0].getDepth() > 8) { if (!flif_decode_FLIF2_inner_vertical<IO,Rac,Coder,Plane<ColorVal_intern_16u>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress)) return false;}
+                else if (images[0].getDepth() > 8) ok = flif_decode_FLIF2_inner_vertical<IO,Rac,Coder,Plane<ColorVal_intern_16u>,ranges_t>(p,io, rac, coders, images, ranges, beginZL, endZL, quality, scale, i, z, predictor, zoomlevels, transforms, options.invisible_predictor, progress);
 #endif
 
         }
+        if (options.stats) options.stats->add_symbols(p, z, io.ftell() - start_pos, coders[p].symbols() - start_symbols, coders[p].visited_nodes() - start_visited);
+        if (!ok) return false;
         if (endZL==0) {
           v_printf(3,"    read %li bytes   ", io.ftell());
           v_printf(5,"\n");
@@ -827,7 +916,7 @@ bool flif_decode_FLIF2_pass(IO &io, Rac &rac, Images &images, const ColorRanges
     for (int p = 0; p < images[0].numPlanes(); p++) {
         Ranges propRanges;
         initPropRanges(propRanges, *ranges, p);
-        coders.emplace_back(rac, propRanges, forest[p], 0, options.cutoff, options.alpha);
+        add_coder(coders, rac, propRanges, forest[p], options);
     }
 
     if (beginZL == images[0].zooms() && endZL > 0) {
@@ -844,27 +933,31 @@ bool flif_decode_FLIF2_pass(IO &io, Rac &rac, Images &images, const ColorRanges
         }
       }
     }
-#if LARGE_BINARY > 1
-    // de-virtualize some of those ColorRanges
+#if LARGE_BINARY > 0
+    // de-virtualize the most common ColorRanges, so snap() can be inlined in the pixel loops
+    if (const ColorRangesBounds * rangesB = dynamic_cast<const ColorRangesBounds*>(ranges)) {
+        if (const ColorRangesYCoCg * rangesYCoCg = dynamic_cast<const ColorRangesYCoCg*>(rangesB->getRanges())) {
+            const ColorRangesBoundsOf<ColorRangesYCoCg> rangesBY(rangesB->getBounds(), rangesYCoCg);
+            return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRangesBoundsOf<ColorRangesYCoCg>>(io, rac, coders, images, &rangesBY, beginZL, endZL, options, transforms, callback, user_data, partial_images, progress);
+        }
+    }
     if (const ColorRangesCB * rangesCB = dynamic_cast<const ColorRangesCB*>(ranges))
-        return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRangesCB>(io, rac, coders, images, rangesCB, beginZL, endZL, options, transforms, callback, user_data, partial_images);
-    if (const ColorRangesBounds * rangesB = dynamic_cast<const ColorRangesBounds*>(ranges))
-        return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRangesBounds>(io, rac, coders, images, rangesB, beginZL, endZL, options, transforms, callback, user_data, partial_images);
-    else
+        return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRangesCB>(io, rac, coders, images, rangesCB, beginZL, endZL, options, transforms, callback, user_data, partial_images, progress);
 #endif
-        return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRanges>(io, rac, coders, images, ranges, beginZL, endZL, options, transforms, callback, user_data, partial_images, progress);
+    return flif_decode_FLIF2_inner<IO,Rac,Coder,ColorRanges>(io, rac, coders, images, ranges, beginZL, endZL, options, transforms, callback, user_data, partial_images, progress);
 }
 
 
 
-template<typename IO, typename BitChance, typename Rac> bool flif_decode_tree(FLIF_UNUSED(IO& io), Rac &rac, const ColorRanges *ranges, std::vector<Tree> &forest, const flifEncoding encoding)
+template<typename IO, typename BitChance, typename Rac> bool flif_decode_tree(FLIF_UNUSED(IO& io), Rac &rac, const ColorRanges *ranges, std::vector<Tree> &forest, const flifEncoding encoding, DecoderArena *arena)
 {
+    const int cut = 2, alpha = 0xFFFFFFFF / 19;
     try {
       for (int p = 0; p < ranges->numPlanes(); p++) {
         Ranges propRanges;
         if (encoding==flifEncoding::nonInterlaced) initPropRanges_scanlines(propRanges, *ranges, p);
         else initPropRanges(propRanges, *ranges, p);
-        MetaPropertySymbolCoder<BitChance, Rac> metacoder(rac, propRanges);
+        MetaPropertySymbolCoder<BitChance, Rac> metacoder(rac, propRanges, cut, alpha, arena ? arena->table(cut, alpha) : nullptr);
         if (ranges->min(p)<ranges->max(p))
         if (!metacoder.read_tree(forest[p])) {return false;}
 //        forest[p].print(stdout);
@@ -880,6 +973,7 @@ template <int bits, typename IO>
 bool flif_decode_main(RacIn<IO>& rac, IO& io, Images &images, const ColorRanges *ranges,
         std::vector<Transform<IO>*> &transforms, flif_options &options, callback_t callback, void *user_data, Images &partial_images, Progress &progress) {
     int scale=options.scale;
+    const CropWindow window(options, images[0]);
     std::vector<Tree> forest(ranges->numPlanes(), Tree());
     int roughZL = 0;
     if (options.method.encoding == flifEncoding::interlaced) {
@@ -887,30 +981,38 @@ bool flif_decode_main(RacIn<IO>& rac, IO& io, Images &images, const ColorRanges
 //      if (roughZL < 0) roughZL = 0;
       UniformSymbolCoder<RacIn<IO>> metaCoder(rac);
       roughZL = metaCoder.read_int(0,images[0].zooms());
+      // large images: decode from planes in zoomlevel-major order, which are converted back to raster order at the end
+      if (!callback && images.size() == 1 && scale == 1 && (uint64_t)images[0].rows() * images[0].cols() >= ZOOMLEVEL_STORAGE_MIN_PIXELS) {
+        for (int p = 0; p < images[0].numPlanes(); p++) images[0].getPlane(p).store_zoomlevels_from(images[0].zooms());
+      }
 //      v_printf(2,"Decoding rough data\n");
+      PhaseTimer timer(PHASE_ROUGH_PASS, options.stats);
       if (!flif_decode_FLIF2_pass<IO, RacIn<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacIn<IO>, bits> >(io, rac, images, ranges, forest, images[0].zooms(), roughZL+1, options, transforms, callback, user_data, partial_images, progress)) {
         std::vector<int> zoomlevels(ranges->numPlanes(),roughZL);
-        flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms);
+        flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms, &window);
         return false;
       }
     }
     if (options.method.encoding == flifEncoding::interlaced && (options.quality <= 0 || progress.pixels_done >= progress.pixels_todo) && progress.pixels_todo > 1) {
       v_printf(3,"Not decoding MANIAC tree (%i pixels done, had %i pixels to do)\n", progress.pixels_done, progress.pixels_todo);
       std::vector<int> zoomlevels(ranges->numPlanes(),roughZL);
-      flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms);
+      flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms, &window);
       return progress.pixels_done >= progress.pixels_todo;
     } else {
       v_printf(3,"Decoded header + rough data. Decoding MANIAC tree.\n");
-      if (!flif_decode_tree<IO, FLIFBitChanceTree, RacIn<IO>>(io, rac, ranges, forest, options.method.encoding)) {
+      PhaseTimer timer(PHASE_TREE, options.stats);
+      if (!flif_decode_tree<IO, FLIFBitChanceTree, RacIn<IO>>(io, rac, ranges, forest, options.method.encoding, options.arena)) {
          if (options.method.encoding == flifEncoding::interlaced) {
             v_printf(1,"File probably truncated in the middle of MANIAC tree representation. Interpolating.\n");
             std::vector<int> zoomlevels(ranges->numPlanes(),roughZL);
-            flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms);
+            flif_decode_FLIF2_inner_interpol(images, ranges, 0, 0, -1, scale, zoomlevels, transforms, &window);
          }
          return false;
       }
+      if (options.stats) options.stats->set_forest(forest);
     }
 
+    PhaseTimer timer(PHASE_FINAL_PASS, options.stats);
     switch(options.method.encoding) {
         case flifEncoding::nonInterlaced: v_printf(3,"Decoding data (scanlines)\n");
                 return flif_decode_scanlines_pass<IO, RacIn<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacIn<IO>, bits> >(io, rac, images, ranges, forest, options, transforms, callback, user_data, partial_images, progress);
@@ -952,6 +1054,8 @@ int read_chunk(IO& io, MetaData& metadata) {
     if (strcmp(metadata.name,"iCCP")
      && strcmp(metadata.name,"eXif")
      && strcmp(metadata.name,"eXmp")
+     && strcmp(metadata.name,"TILE")
+     && strcmp(metadata.name,"tRnc")
     ) {
         if (metadata.name[0] > 'Z') v_printf(1,"Warning: Encountered unknown chunk: %s\n",metadata.name);
         else { e_printf("Error: Encountered unknown critical chunk: %s\n",metadata.name); return -1; }
@@ -965,12 +1069,252 @@ int read_chunk(IO& io, MetaData& metadata) {
     return 0; // read next chunk
 }
 
+// pick the downscale factor that gives the requested resize/fit target dimensions
+bool decode_target_scale(flif_options &options, const int width, const int height, int &target_w, int &target_h) {
+    int rw = options.resize_width;
+    int rh = options.resize_height;
+    if (rw < 0 || rh < 0) { e_printf("Negative target dimension? Really?\n"); return false; }
+    target_w = rw; target_h = rh;
+    if (options.fit) {
+        if (rw <= 0 && rh <= 0) { e_printf("Invalid target dimensions.\n"); return false;}
+        // use larger decode dimensions to make sure we have good chroma
+        rw = rw*2-1; rh = rh*2-1;
+    }
+    if (rw || rh) {
+      if (options.scale > 1) e_printf("Don't use -s and (-r or -f) at the same time! Ignoring -s...\n");
+      int scale = 1;
+      while ( (rw>0 && (((width-1)/scale)+1) > rw)   || (rh>0 && (((height-1)/scale)+1) > rh) ) scale *= 2;
+      options.scale = scale;
+    }
+    return true;
+}
+
+struct TileInfo {
+    uint32_t width = 0, height = 0;     // 0 = not a tiled FLIF file
+    std::vector<size_t> lengths;        // length in bytes of every tile
+};
+
+bool output_buffer_fits(const Image &image, const PixelBuffer &output) {
+    if (image.cols() != output.width || image.rows() != output.height) {
+        e_printf("Output buffer is %ux%u, but the decoded image is %ux%u\n", output.width, output.height, (unsigned int)image.cols(), (unsigned int)image.rows());
+        return false;
+    }
+    if (output.stride < (size_t)output.width * output.depth / 2) {
+        e_printf("Output buffer stride is too small\n");
+        return false;
+    }
+    return true;
+}
+
+// Writes the image into the caller's buffer, undoing the given row-wise inverse transforms (in that order) on the way.
+// Bands of rows are done in parallel; each row is loaded once and stays in cache until it is packed.
+template <typename IO>
+void write_output_rows(const std::vector<const Transform<IO>*> &steps, const Image &image, const PixelBuffer &output, const int nb_threads) {
+    const int nump = image.numPlanes();
+    const uint32_t cols = image.cols(), band = 64;
+    const size_t nb_bands = (output.height + band - 1) / band;
+    parallel_for(nb_bands, nb_threads, [&](size_t b) {
+        std::vector<ColorVal> buffer((size_t)nump * cols);
+        std::vector<ColorVal*> row(nump);
+        for (uint32_t r = b * band; r < output.height && r < (b + 1) * band; r++) {
+            for (int p = 0; p < nump; p++) {
+                row[p] = &buffer[(size_t)p * cols];
+                image.get_row(p, r, row[p]);
+            }
+            for (const Transform<IO> *t : steps) t->invData_row(row.data(), nump, cols);
+            image.write_RGBA_row(row.data(), nump, r, output);
+        }
+    });
+}
+
+// hand the pixels over to the caller's buffer (unless the inverse transforms already did) and drop the planes
+template <typename IO>
+bool flif_write_output(Image &image, const PixelBuffer &output, const bool written, const int nb_threads) {
+    if (!written) {
+        if (!output_buffer_fits(image, output)) return false;
+        write_output_rows<IO>({}, image, output, nb_threads);
+    }
+    image.reset();
+    return true;
+}
+
+// Tiled FLIF: every tile is a complete FLIF file (see flif_encode_tiles), so decode them independently and
+// stitch them together.
+template <typename IO>
+bool flif_decode_tiles(IO& io, Images &images, callback_t callback, void *user_data, Images &partial_images, flif_options &options,
+                       const int width, const int height, const int numFrames, const TileInfo &tiling, const std::vector<MetaData> &metadata,
+                       const bool just_identify, FLIF_INFO* info, PixelBuffer *output) {
+    const uint32_t tile_w = tiling.width, tile_h = tiling.height;
+    const uint32_t nx = (width-1)/tile_w+1, ny = (height-1)/tile_h+1;
+    if (tiling.lengths.size() != (size_t)nx*ny) { e_printf("Invalid FLIF file (inconsistent tiles)\n"); return false; }
+    if (options.show_breakpoints) { e_printf("Tiled FLIF file, no breakpoints to report.\n"); return false; }
+    const flifEncoding encoding = options.method.encoding;
+
+    // with a crop window, only the tiles that overlap it are decoded (the window is checked by the caller)
+    const bool cropped = options.crop_width > 0 && !just_identify && !info;
+    auto wanted = [&](size_t i) {
+        const uint32_t x0 = (i % nx) * tile_w, y0 = (i / nx) * tile_h;
+        return !cropped || (x0 < (uint32_t)(options.crop_x + options.crop_width) && (uint32_t)options.crop_x < x0 + tile_w
+                            && y0 < (uint32_t)(options.crop_y + options.crop_height) && (uint32_t)options.crop_y < y0 + tile_h);
+    };
+    std::vector<std::vector<uint8_t>> tiles(tiling.lengths.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+        const bool keep = wanted(i);
+        for (size_t j = 0; j < tiling.lengths[i]; j++) {
+            int byte = io.get_c();
+            if (byte < 0) break;
+            if (keep) tiles[i].push_back(byte);
+        }
+    }
+
+    if (just_identify || info) {
+        FLIF_INFO tile_info;
+        BlobReader reader(tiles[0].data(), tiles[0].size());
+        Images dummy;
+        flif_options tile_options = options;
+        tile_options.scale = 1;
+        tile_options.stats = NULL;
+        metadata_options md = {false, false, false};
+        if (!flif_decode(reader, dummy, NULL, NULL, 0, dummy, tile_options, md, &tile_info)) return false;
+        tile_info.width = width;
+        tile_info.height = height;
+        if (info) { *info = tile_info; return true; }
+        v_printf(1,"%s: ",io.getName());
+        if (numFrames == 1) v_printf(1,"FLIF image");
+        else v_printf(1,"FLIF animation, %i frames",numFrames);
+        v_printf(1,", %ux%u, %i-bit ", width, height, tile_info.bit_depth);
+        if (tile_info.channels == 1) v_printf(1,"grayscale");
+        else if (tile_info.channels == 3) v_printf(1,"RGB");
+        else if (tile_info.channels == 4) v_printf(1,"RGBA");
+        if (encoding == flifEncoding::nonInterlaced) v_printf(1,", non-interlaced");
+        else if (encoding == flifEncoding::interlaced) v_printf(1,", interlaced");
+        v_printf(1,", %u tiles of %ux%u\n", nx*ny, tile_w, tile_h);
+        return true;
+    }
+
+    int target_w, target_h;
+    if (!decode_target_scale(options, width, height, target_w, target_h)) return false;
+    int scale = options.scale;
+    if (scale != 1 && encoding==flifEncoding::nonInterlaced) { v_printf(1,"Cannot decode non-interlaced FLIF file at lower scale! Ignoring resize target...\n"); scale = 1;}
+    while (scale > 1 && (tile_w % scale || tile_h % scale)) scale /= 2;
+    if (scale != options.scale) v_printf(2,"Tile size is not a multiple of the requested scale, decoding at scale 1:%i instead\n", scale);
+    const int scale_shift = ilog2(scale);
+
+    // every tile collects its own statistics, which are added up afterwards
+    std::mutex stats_mutex;
+    auto decode_tile = [&](size_t i, Images &tile) -> bool {
+        BlobReader reader(tiles[i].data(), tiles[i].size());
+        flif_options tile_options = options;
+        tile_options.scale = scale;
+        tile_options.resize_width = tile_options.resize_height = tile_options.fit = 0;
+        tile_options.crop_width = 0;
+        tile_options.keep_palette = 0;
+        FLIF_STATS tile_stats;
+        tile_options.stats = (options.stats ? &tile_stats : NULL);
+        metadata_options md = {false, false, false};
+        const bool ok = flif_decode(reader, tile, tile_options, md);
+        if (options.stats) {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            options.stats->merge(tile_stats);
+        }
+        if (!ok) return false;
+        // the tile must have the expected dimensions and the same format as the first tile
+        const uint32_t x0 = (i % nx) * tile_w, y0 = (i / nx) * tile_h;
+        if ((int)tile.size() != numFrames
+            || tile[0].cols() != ((std::min(tile_w, width-x0)-1) >> scale_shift) + 1
+            || tile[0].rows() != ((std::min(tile_h, height-y0)-1) >> scale_shift) + 1) return false;
+        if (!images.empty() && (tile[0].numPlanes() != images[0].numPlanes() || tile[0].max(0) != images[0].max(0))) return false;
+        return true;
+    };
+    // the decoded pixels that are kept: columns wx0..wx1-1 of rows wy0..wy1-1 (at the decode scale)
+    uint32_t wx0 = 0, wy0 = 0, wx1 = ((width-1) >> scale_shift) + 1, wy1 = ((height-1) >> scale_shift) + 1;
+    if (cropped) crop_window_scaled(options, scale_shift, wx0, wy0, wx1, wy1);
+    // a stitched tile is not needed anymore, the next tiles can reuse its buffers
+    auto recycle = [&](Images &tile) {
+        if (options.arena) for (Image &image : tile) image.recycle(options.arena->planes);
+        tile.clear();
+    };
+    auto stitch = [&](size_t i, const Images &tile) {
+        const uint32_t x0 = ((i % nx) * tile_w) >> scale_shift, y0 = ((i / nx) * tile_h) >> scale_shift;
+        const uint32_t c0 = std::max(x0, wx0), c1 = std::min(x0 + (uint32_t)tile[0].cols(), wx1);
+        const uint32_t r0 = std::max(y0, wy0), r1 = std::min(y0 + (uint32_t)tile[0].rows(), wy1);
+        for (int fr = 0; fr < numFrames; fr++)
+            for (int p = 0; p < images[fr].numPlanes(); p++)
+                for (uint32_t r = r0; r < r1; r++)
+                    for (uint32_t c = c0; c < c1; c++)
+                        images[fr].set(p, r-wy0, c-wx0, tile[fr](p,r-y0,c-x0));
+    };
+
+    // the first tile determines the number of channels and the bit depth
+    size_t first_tile = 0;
+    while (!wanted(first_tile)) first_tile++;
+    Images first;
+    if (!decode_tile(first_tile, first)) { e_printf("Could not decode the first tile.\n"); return false; }
+    uint64_t estimated_buffer_size = (uint64_t)(((width-1)/scale)+1) * (uint64_t)(((height-1)/scale)+1) * (uint64_t)numFrames * (uint64_t)first[0].numPlanes() * (first[0].max(0) > 255 ? 2 : 1);
+    if (estimated_buffer_size > MAX_IMAGE_BUFFER_SIZE) {
+        e_printf("This is going to take too much memory (%llu > %llu). Aborting.\nCompile with a higher MAX_IMAGE_BUFFER_SIZE if you really want to do this.\n",estimated_buffer_size, MAX_IMAGE_BUFFER_SIZE); return false;
+    }
+    if (numFrames > MAX_FRAMES) {
+        e_printf("Too many frames. Aborting.\nCompile with a higher MAX_FRAMES value if you really want to do this.\n");
+        return false;
+    }
+    for (int i=0; i<numFrames; i++) {
+      images.push_back(Image());
+      if (!images[i].init(wx1-wx0,wy1-wy0,0,first[i].max(0),first[i].numPlanes(),plane_buffers(options))) return false;
+      images[i].alpha_zero_special = first[i].alpha_zero_special;
+      images[i].frame_delay = first[i].frame_delay;
+      images[i].metadata = metadata;
+      if (callback) partial_images.push_back(Image(scale_shift));
+    }
+    stitch(first_tile, first);
+    bool fully_decoded = first[0].fully_decoded;
+    recycle(first);
+
+    enum { TILE_DECODED, TILE_MISSING, TILE_FAILED };
+    std::vector<char> status(tiles.size(), TILE_DECODED), tile_complete(tiles.size(), true);
+    tile_complete[first_tile] = fully_decoded;
+    parallel_for(tiles.size()-1, options.threads, [&](size_t j) {
+        const size_t i = (j < first_tile ? j : j+1);
+        if (!wanted(i)) return;
+        if (tiles[i].empty()) { status[i] = TILE_MISSING; tile_complete[i] = false; return; } // truncated file, leave the tile empty
+        Images tile;
+        if (!decode_tile(i, tile)) { status[i] = TILE_FAILED; return; }
+        stitch(i, tile);
+        tile_complete[i] = tile[0].fully_decoded;
+        recycle(tile);
+    });
+    int missing = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (status[i] == TILE_FAILED) { e_printf("Could not decode tile %i.\n", (int)i); return false; }
+        if (status[i] == TILE_MISSING) missing++;
+        if (!tile_complete[i]) fully_decoded = false;
+    }
+    if (missing) v_printf(1,"File ended prematurely, %i of %i tiles are missing.\n", missing, (int)tiles.size());
+
+    for (Image& i : images) {
+        i.normalize_scale();
+        i.fully_decoded = fully_decoded;
+        if (options.stats) options.stats->peak_plane_memory += i.plane_memory();
+    }
+    v_printf_tty(2,"\r");
+    v_printf(2,"Decoded input file %s, %li bytes for %ux%u pixels in %u tiles\n",io.getName(),io.ftell(), images[0].cols(), images[0].rows(), nx*ny);
+
+    if (options.fit) downsample(width, height, target_w, target_h, images);
+
+    if (callback) {
+        auto populatePartialImages = [&] () {
+          for (unsigned int n=0; n < images.size(); n++) partial_images[n] = images[n].clone(); // make a copy to work with
+        };
+        issue_callback(callback, user_data, 10000, io.ftell(), true, populatePartialImages);
+    }
+    if (output && !flif_write_output<IO>(images[0], *output, false, options.threads)) return false;
+    return true;
+}
+
 template <typename IO>
-bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, int first_callback_quality, Images &partial_images, flif_options &options, metadata_options &md, FLIF_INFO* info) {
+bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, int first_callback_quality, Images &partial_images, flif_options &options, metadata_options &md, FLIF_INFO* info, PixelBuffer *output) {
     int quality = options.quality;
     int scale = options.scale;
-    int rw = options.resize_width;
-    int rh = options.resize_height;
 
     bool fit = options.fit;
     bool just_identify = false;
@@ -1042,6 +1386,10 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
         e_printf("Unsensical number of frames < 0.\n");
         return false;
     }
+    if (output && numFrames > 1) {
+        e_printf("Cannot decode an animation into a single output buffer.\n");
+        return false;
+    }
 #ifndef SUPPORT_ANIMATION
     if (numFrames > 1) {
         e_printf("This FLIF cannot decode animations. Please compile with SUPPORT_ANIMATION.\n");
@@ -1049,8 +1397,17 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
     }
 #endif
     MetaData chunk;
+    TileInfo tiling;
     int result = 0;
     while (!(result = read_chunk(io, chunk))) {
+        if (!strcmp(chunk.name, "TILE")) {
+            BlobReader reader(chunk.contents.data(), chunk.length);
+            tiling.width = read_big_endian_varint(reader) + 1;
+            tiling.height = read_big_endian_varint(reader) + 1;
+            while (reader.ftell() < (long)chunk.length) tiling.lengths.push_back(read_big_endian_varint(reader));
+            continue;
+        }
+        if (!strcmp(chunk.name, "tRnc")) continue; // only used to truncate the file, not image metadata
         if (!md.icc && !strcmp(chunk.name, "iCCP")) continue;
         if (!md.exif && !strcmp(chunk.name, "eXif")) continue;
         if (!md.xmp && !strcmp(chunk.name, "eXmp")) continue;
@@ -1067,6 +1424,10 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
         return true;
     }
 
+    if (!just_identify && !info && !crop_window_fits(options, width, height, numFrames)) return false;
+
+    if (tiling.width) return flif_decode_tiles(io, images, callback, user_data, partial_images, options, width, height, numFrames, tiling, metadata, just_identify, info, output);
+
     if (options.show_breakpoints) v_printf(1,"Image data starts at offset %li\n",io.ftell());
 
     RacIn<IO> rac(io);
@@ -1143,19 +1504,9 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
         // ignored for now (assuming loop forever)
         metaCoder.read_int(0, 100); // repeats (0=infinite)
     }
-    if (rw < 0 || rh < 0) { e_printf("Negative target dimension? Really?\n"); return false; }
-    int target_w = rw, target_h = rh;
-    if (fit) {
-        if (rw <= 0 && rh <= 0) { e_printf("Invalid target dimensions.\n"); return false;}
-        // use larger decode dimensions to make sure we have good chroma
-        rw = rw*2-1; rh = rh*2-1;
-    }
-    if (rw || rh) {
-      if (scale > 1) e_printf("Don't use -s and (-r or -f) at the same time! Ignoring -s...\n");
-      scale = 1;
-      while ( (rw>0 && (((width-1)/scale)+1) > rw)   || (rh>0 && (((height-1)/scale)+1) > rh) ) scale *= 2;
-      options.scale = scale;
-    }
+    int target_w, target_h;
+    if (!decode_target_scale(options, width, height, target_w, target_h)) return false;
+    scale = options.scale;
     if (scale != 1 && encoding==flifEncoding::nonInterlaced) { v_printf(1,"Cannot decode non-interlaced FLIF file at lower scale! Ignoring resize target...\n"); scale = 1;}
 
     int scale_shift = ilog2(scale);
@@ -1282,12 +1633,12 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
     // actually allocate the buffers
     bool smaller_buffer=false;
     // set smaller_buffer to true if it can be decoded to PNG8 (8-bit palette)
-    if (images[0].palette && ranges->max(1) < 256 && options.keep_palette && (ranges->numPlanes() < 4 || ranges->min(3)==ranges->max(3))) smaller_buffer = true;
+    if (images[0].palette && ranges->max(1) < 256 && options.keep_palette && !output && (ranges->numPlanes() < 4 || ranges->min(3)==ranges->max(3))) smaller_buffer = true;
 
     // Y plane shouldn't be constant, even if it is (because we want to avoid special-casing fast Y plane access)
     if (!smaller_buffer) for (int fr = 0; fr < numFrames; fr++) images[fr].undo_make_constant_plane(0);
 
-    for (int fr = 0; fr < numFrames; fr++) if (! images[fr].real_init(smaller_buffer)) return false;
+    for (int fr = 0; fr < numFrames; fr++) if (! images[fr].real_init(smaller_buffer, plane_buffers(options))) return false;
 
     // Alpha plane is never special if it is never zero
     if (ranges->numPlanes()>3 && ranges->min(3) > 0)
@@ -1321,6 +1672,8 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
        fully_decoded = flif_decode_main<18>(rac, io, images, ranges, transform_ptrs, options, callback, user_data, partial_images, progress);
 #endif
     }
+    for (Image& image : images) image.restore_raster_layout();
+    if (options.stats) options.stats->update_memory(images);
 
    v_printf_tty(2,"\r");
    if (numFrames==1)
@@ -1336,6 +1689,33 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
             i.fully_decoded=true;
     }
 
+    // only the crop window goes through the inverse transforms
+    if (options.crop_width > 0) {
+        uint32_t x0, y0, x1, y1;
+        crop_window_scaled(options, scale_shift, x0, y0, x1, y1);
+        for (Image& i : images) i.crop(x0, y0, x1-x0, y1-y0);
+        v_printf(3,"Cropped to %ux%u pixels at offset %u,%u\n", x1-x0, y1-y0, x0, y0);
+    }
+
+    // the outermost row-wise inverse transforms are done row by row while writing into the output buffer,
+    // unless the planes are still needed afterwards (checksum, downscaling, final callback)
+    bool output_written = false;
+    {
+    PhaseTimer timer(PHASE_INV_DATA, options.stats);
+    if (output && !fit && !callback && !options.crc_check && !transform_ptrs.empty()) {
+      size_t fused = 0;
+      while (fused < transform_ptrs.size() && transform_ptrs[fused]->inv_row_wise()) fused++;
+      while(transform_ptrs.size() > fused) {
+        transform_ptrs.back()->invData(images);
+        transform_ptrs.pop_back();
+      }
+      if (!output_buffer_fits(images[0], *output)) return false;
+      std::vector<const Transform<IO>*> steps(transform_ptrs.rbegin(), transform_ptrs.rend());
+      write_output_rows<IO>(steps, images[0], *output, options.threads);
+      transform_ptrs.clear();
+      output_written = true;
+    }
+
     if (!smaller_buffer || !images[0].palette) {
       while(!transform_ptrs.empty()) {
         transform_ptrs.back()->invData(images);
@@ -1364,6 +1744,8 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
         for (Image& i : images) i.palette_image = p_image;
       }
     }
+    }
+    if (options.stats) options.stats->update_memory(images);
     transforms.clear();
     rangesList.clear();
 
@@ -1372,10 +1754,15 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
       v_printf(3,"Not checking checksum, as requested.\n");
     } else if (images[0].palette_image) {
       v_printf(2,"Not checking checksum, palette image not decoded to full RGBA.\n");
+    } else if (options.crop_width > 0) {
+      v_printf(3,"Not checking checksum, only a part of the image was decoded.\n");
+      // same pixels as the uncropped image, which has to make them black to check the checksum
+      if (alphazero && quality>=100 && scale==1 && fully_decoded && contains_checksum) for (Image& image : images) image.make_invisible_rgb_black();
     } else if (quality>=100 && scale==1 && fully_decoded) {
       if (contains_checksum) {
         // don't bother making the invisible pixels black if we're not checking the crc anyway
         if (alphazero && options.crc_check) for (Image& image : images) image.make_invisible_rgb_black();
+        PhaseTimer timer(PHASE_CHECKSUM, options.stats);
         const uint32_t checksum = images[0].checksum();
         v_printf(8,"Computed checksum: %X\n", checksum);
         uint32_t checksum2 = metaCoder.read_int(16);
@@ -1413,11 +1800,63 @@ bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, i
         issue_callback(callback, user_data, progress.quality(), io.ftell(), true, populatePartialImages);
     }
 
+    if (output && !flif_write_output<IO>(images[0], *output, output_written, options.threads)) return false;
+
     if (options.metadata) {
       images[0].metadata = metadata;
     }
     return true;
 }
 
-template bool flif_decode(FileIO& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &, metadata_options &, FLIF_INFO* info);
-template bool flif_decode(BlobReader& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &, metadata_options &, FLIF_INFO* info);
+bool flif_truncation_length(const uint8_t *data, size_t size, int scale, int quality, size_t &length) {
+    BlobReader io(data, size);
+    char buff[5];
+    if (!io.gets(buff,5) || strcmp(buff,"FLIF")) { e_printf("Not a FLIF file\n"); return false; }
+    int c = io.get_c();
+    if (c < ' ' || c > ' '+32+15+32) { e_printf("Invalid or unknown FLIF format byte\n"); return false;}
+    c -= ' ';
+    bool animated = false;
+    if (c > 47) { c -= 32; animated = true; }
+    if (c/16 != 2) { e_printf("Non-interlaced FLIF file, cannot be truncated\n"); return false; }
+    io.get_c(); // bit depth
+    read_big_endian_varint(io); // width
+    read_big_endian_varint(io); // height
+    if (animated) read_big_endian_varint(io);
+
+    MetaData chunk;
+    std::map<int, long> scales, qualities;
+    int result = 0;
+    while (!(result = read_chunk(io, chunk))) {
+        if (!strcmp(chunk.name, "TILE")) { e_printf("Tiled FLIF file, cannot be truncated\n"); return false; }
+        if (strcmp(chunk.name, "tRnc")) continue;
+        BlobReader reader(chunk.contents.data(), chunk.length);
+        for (size_t n = read_big_endian_varint(reader); n > 0 && !reader.isEOF(); n--) {
+            int s = read_big_endian_varint(reader);
+            scales[1<<s] = read_big_endian_varint(reader);
+        }
+        for (size_t n = read_big_endian_varint(reader); n > 0 && !reader.isEOF(); n--) {
+            int q = read_big_endian_varint(reader);
+            qualities[q] = read_big_endian_varint(reader);
+        }
+    }
+    if (result != 1) { e_printf("Invalid FLIF file\n"); return false; }
+    if (scales.empty()) { e_printf("This FLIF file has no truncation index (encode it with --truncation-index)\n"); return false; }
+    const long data_start = io.ftell();
+
+    // the decoder stops at whichever target it reaches first; a quality that is not in the index is rounded up
+    long end = size;
+    if (scale > 1) {
+        auto s = scales.find(scale);
+        if (s != scales.end()) end = std::min(end, data_start + s->second);
+    }
+    if (quality < 100) {
+        auto q = qualities.lower_bound(quality);
+        if (q != qualities.end()) end = std::min(end, data_start + q->second);
+    }
+    length = end;
+    return true;
+}
+
+template bool flif_decode(FileIO& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &, metadata_options &, FLIF_INFO* info, PixelBuffer *output);
+template bool flif_decode(BlobReader& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &, metadata_options &, FLIF_INFO* info, PixelBuffer *output);
+template bool flif_decode(StreamReader& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &, metadata_options &, FLIF_INFO* info, PixelBuffer *output);
@@ -18,9 +18,16 @@ typedef uint32_t (*callback_t)(uint32_t quality, int64_t bytes_read, uint8_t dec
 */
 
 template <typename IO>
-bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &options, metadata_options &md, FLIF_INFO* info);
+bool flif_decode(IO& io, Images &images, callback_t callback, void *user_data, int, Images &partial_images, flif_options &options, metadata_options &md, FLIF_INFO* info, PixelBuffer *output = NULL);
 
 template <typename IO>
 bool flif_decode(IO& io, Images &images, flif_options &options, metadata_options &md) {
     return flif_decode(io, images, NULL, NULL, 0, images, options, md, 0);
 }
+
+/*!
+* Length of the prefix of a FLIF file that is enough to decode it at scale 1:scale and/or the given quality.
+* Only the header and the chunks are read: the offsets come from the truncation index written by the encoder.
+* @return false if the file has no truncation index
+*/
+bool flif_truncation_length(const uint8_t *data, size_t size, int scale, int quality, size_t &length);
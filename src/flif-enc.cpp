@@ -20,6 +20,8 @@
 #ifdef HAS_ENCODER
 #include <string>
 #include <string.h>
+#include <thread>
+#include <mutex>
 
 #include "maniac/rac.hpp"
 #include "maniac/compound.hpp"
@@ -32,9 +34,20 @@
 
 #include "common.hpp"
 #include "fileio.hpp"
+#include "flif-enc.hpp"
 
 using namespace maniac::util;
 
+RowSample learning_sample(const Images &images, const flif_options &options) {
+    RowSample sample;
+    if (images.empty()) return sample;
+    const double pixels = (double)images[0].rows()*images[0].cols()*images.size();
+    const double learn_sample = options.learn_sample * 1e6;
+    if (learn_sample > 0 && pixels > learn_sample)
+        sample.keep = std::max(1, (int)(16 * sqrt(learn_sample / pixels) + 0.5));
+    return sample;
+}
+
 template<typename RAC> void static write_name(RAC& rac, std::string desc) {
     int nb = 0;
     while (nb <= MAX_TRANSFORM) {
@@ -50,7 +63,8 @@ template<typename RAC> void static write_name(RAC& rac, std::string desc) {
 // alphazero = false: image either has no alpha plane, or A=0 has no special meaning
 // FRA = true: image has FRA plane (animation with lookback)
 template<typename IO, typename Rac, typename Coder>
-void flif_encode_scanlines_inner(IO& io, FLIF_UNUSED(Rac& rac), std::vector<Coder> &coders, const Images &images, const ColorRanges *ranges, Progress &progress) {
+void flif_encode_scanlines_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const Images &images, const ColorRanges *ranges, Progress &progress, const int only_plane,
+                                 const RowSample &sample, FLIF_STATS *stats) {
     const std::vector<ColorVal> greys = computeGreys(ranges);
     ColorVal min,max;
     long fs = io.ftell();
@@ -64,12 +78,16 @@ void flif_encode_scanlines_inner(IO& io, FLIF_UNUSED(Rac& rac), std::vector<Code
         int p=PLANE_ORDERING[k];
         if (p>=nump) continue;
         i++;
+        if (only_plane >= 0 && p != only_plane) continue;
         if (ranges->min(p) >= ranges->max(p)) continue;
         const ColorVal minP = ranges->min(p);
         Properties properties((nump>3?NB_PROPERTIES_scanlinesA[p]:NB_PROPERTIES_scanlines[p]));
         v_printf_tty(2,"\r%i%% done [%i/%i] ENC[%ux%u]    ",(int)(100*progress.pixels_done/progress.pixels_todo),i,nump,images[0].cols(),images[0].rows());
         progress.pixels_done += images[0].cols()*images[0].rows();
+        const long start_pos = rac.decoder_position();
+        const uint64_t start_symbols = coders[p].symbols(), start_visited = coders[p].visited_nodes();
         for (uint32_t r = 0; r < images[0].rows(); r++) {
+            if (!sample(r, images[0].rows())) continue;
             for (int fr=0; fr< (int)images.size(); fr++) {
               const Image& image = images[fr];
               if (image.seen_before >= 0) continue;
@@ -89,6 +107,7 @@ void flif_encode_scanlines_inner(IO& io, FLIF_UNUSED(Rac& rac), std::vector<Code
               }
             }
         }
+        if (stats) stats->add_symbols(p, 0, rac.decoder_position() - start_pos, coders[p].symbols() - start_symbols, coders[p].visited_nodes() - start_visited);
         long nfs = io.ftell();
         if (nfs-fs > 0) {
            v_printf(3,"filesize : %li (+%li for %li pixels, %f bpp)", nfs, nfs-fs, pixels, 8.0*(nfs-fs)/pixels );
@@ -99,7 +118,8 @@ void flif_encode_scanlines_inner(IO& io, FLIF_UNUSED(Rac& rac), std::vector<Code
 }
 
 template<typename IO, typename Rac, typename Coder>
-void flif_encode_scanlines_pass(IO& io, Rac &rac, const Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, int repeats, flif_options &options, Progress &progress) {
+void flif_encode_scanlines_pass(IO& io, Rac &rac, const Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, int repeats, flif_options &options, Progress &progress, const int only_plane = -1,
+                                FLIF_STATS *stats = NULL, const RowSample &sample = RowSample()) {
 
     std::vector<Coder> coders;
     coders.reserve(ranges->numPlanes());
@@ -107,93 +127,138 @@ void flif_encode_scanlines_pass(IO& io, Rac &rac, const Images &images, const Co
     for (int p = 0; p < ranges->numPlanes(); p++) {
         Ranges propRanges;
         initPropRanges_scanlines(propRanges, *ranges, p);
-        coders.emplace_back(rac, propRanges, forest[p], options.split_threshold, options.cutoff, options.alpha);
+        coders.emplace_back(rac, propRanges, forest[p], sample.scaled(options.split_threshold), options.cutoff, options.alpha);
     }
 
     while(repeats-- > 0) {
-     flif_encode_scanlines_inner<IO,Rac,Coder>(io, rac, coders, images, ranges, progress);
+     flif_encode_scanlines_inner<IO,Rac,Coder>(io, rac, coders, images, ranges, progress, only_plane, sample, stats);
     }
 
     for (int p = 0; p < ranges->numPlanes(); p++) {
-        coders[p].simplify(options.divisor, options.min_size, p);
+        if (only_plane >= 0 && p != only_plane) continue;
+        coders[p].simplify(sample.scaled(options.divisor), sample.scaled(options.min_size), p);
     }
 }
 
-// return the predictor that has the smallest total difference
-int find_best_predictor(const Images &images, const ColorRanges *ranges, const int p, const int z) {
+// Adds the cost estimates of rows [rbegin, rend) of zoomlevel z to cost[p][predictor] (only for the planes in mask).
+// All predictors of all planes are evaluated from one read of the neighbouring pixels.
+static void estimate_predictor_costs_rows(const Images &images, const ColorRanges *ranges, const int z, const uint32_t rbegin, const uint32_t rend,
+                                          const std::vector<bool> &mask, const RowSample &sample, uint64_t cost[][MAX_PREDICTOR+1]) {
     const int zerobonus = 1;
-    ColorVal min,max;
     const int nump = images[0].numPlanes();
     const bool alphazero = (nump>3 && images[0].alpha_zero_special);
 #ifdef SUPPORT_ANIMATION
     const bool FRA = (nump == 5);
 #endif
-    Properties properties((nump>3?NB_PROPERTIESA[p]:NB_PROPERTIES[p]));
-    std::vector<uint64_t> total_size(MAX_PREDICTOR+1, 0);
-    for (int predictor=0; predictor <= MAX_PREDICTOR; predictor++) {
-      //Ranges propRanges;
-      //initPropRanges(propRanges, *ranges, p);
-      //RacDummy dummy;
-      //Tree tree;
-      //PropertySymbolCoder<FLIFBitChancePass1, RacDummy, 18> coder(dummy, propRanges, tree); //, split_threshold, cutoff, alpha);
-      if (z % 2 == 0) {
-        // horizontal: scan the odd rows, output pixel values
-          for (uint32_t r = 1; r < images[0].rows(z); r += 2) {
-            for (int fr=0; fr<(int)images.size(); fr++) {
-              const Image& image = images[fr];
-              if (image.seen_before >= 0) { continue; }
-              uint32_t begin=(image.col_begin[r*image.zoom_rowpixelsize(z)]/image.zoom_colpixelsize(z)),
-                         end=(1+(image.col_end[r*image.zoom_rowpixelsize(z)]-1)/image.zoom_colpixelsize(z));
-              for (uint32_t c = begin; c < end; c++) {
-                    if (alphazero && p<3 && image(3,z,r,c) == 0) continue;
-#ifdef SUPPORT_ANIMATION
-                    if (FRA && p<4 && image(4,z,r,c) > 0) continue;
-#endif
-                    ColorVal guess = predict_and_calcProps(properties,ranges,image,z,p,r,c,min,max,predictor);
-                    ColorVal curr = image(p,z,r,c);
-                    total_size[predictor] += maniac::util::ilog2(abs(curr-guess)) + (curr-guess ? zerobonus : 0);
-                    //if (FRA && p==4 && max > fr) max = fr;
-                    //coder.write_int(properties, min - guess, max - guess, curr - guess);
-              }
+    const bool horizontal = (z % 2 == 0);
+    const uint32_t rows = images[0].rows(z), cols = images[0].cols(z);
+    // the previous planes in the same layout as the properties that predict_and_calcProps() passes to snap()
+    prevPlanes pp[5];
+    for (int p = 0; p < nump && p < 5; p++) if (p < 3) pp[p].resize((p>0) + (p>1) + (nump>3));
+    ColorVal min, max, guess[MAX_PREDICTOR+1];
+    for (uint32_t r = rbegin; r < rend; r++) {
+        if (horizontal && (r & 1) == 0) continue; // horizontal: scan the odd rows
+        if (!sample(r, rows)) continue;
+        for (int fr=0; fr<(int)images.size(); fr++) {
+            const Image& image = images[fr];
+            if (image.seen_before >= 0) continue;
+            uint32_t begin=(image.col_begin[r*image.zoom_rowpixelsize(z)]/image.zoom_colpixelsize(z)),
+                       end=(1+(image.col_end[r*image.zoom_rowpixelsize(z)]-1)/image.zoom_colpixelsize(z));
+            uint32_t step = 1;
+            if (!horizontal) { // vertical: scan the odd columns
+                end |= 1;
+                if (begin>1 && ((begin&1) ==0)) begin--;
+                if (begin==0) begin=1;
+                step = 2;
             }
-          }
-      } else {
-        // vertical: scan the odd columns
-          for (uint32_t r = 0; r < images[0].rows(z); r++) {
-            for (int fr=0; fr<(int)images.size(); fr++) {
-              const Image& image = images[fr];
-              if (image.seen_before >= 0) { continue; }
-              uint32_t begin=(image.col_begin[r*image.zoom_rowpixelsize(z)]/image.zoom_colpixelsize(z)),
-                         end=(1+(image.col_end[r*image.zoom_rowpixelsize(z)]-1)/image.zoom_colpixelsize(z))|1;
-              if (begin>1 && ((begin&1) ==0)) begin--;
-              if (begin==0) begin=1;
-              for (uint32_t c = begin; c < end; c+=2) {
+            const bool bottomPresent = r+1 < rows;
+            for (uint32_t c = begin; c < end; c += step) {
+                for (int p = 0; p < nump; p++) {
+                    if (!mask[p]) continue;
                     if (alphazero && p<3 && image(3,z,r,c) == 0) continue;
 #ifdef SUPPORT_ANIMATION
                     if (FRA && p<4 && image(4,z,r,c) > 0) continue;
 #endif
-                    ColorVal guess = predict_and_calcProps(properties,ranges,image,z,p,r,c,min,max,predictor);
-                    ColorVal curr = image(p,z,r,c);
-                    total_size[predictor] += maniac::util::ilog2(abs(curr-guess)) + (curr-guess ? zerobonus : 0);
-                    //if (FRA && p==4 && max > fr) max = fr;
-                    //coder.write_int(properties, min - guess, max - guess, curr - guess);
-              }
+                    if (p < 3) {
+                        int i = 0;
+                        if (p>0) pp[p][i++] = image(0,z,r,c);
+                        if (p>1) pp[p][i++] = image(1,z,r,c);
+                        if (nump>3) pp[p][i++] = image(3,z,r,c);
+                    }
+                    // same neighbours and border cases as predict_and_calcProps_plane()
+                    if (horizontal) {
+                        const ColorVal top = image(p,z,r-1,c);
+                        const ColorVal left = (c>0 ? image(p,z,r,c-1) : top);
+                        const ColorVal topleft = (c>0 ? image(p,z,r-1,c-1) : top);
+                        const ColorVal bottomleft = (bottomPresent && c>0 ? image(p,z,r+1,c-1) : left);
+                        const ColorVal bottom = (bottomPresent ? image(p,z,r+1,c) : left);
+                        guess[0] = (top + bottom)>>1;
+                        guess[1] = median3(guess[0], (ColorVal)(left+top-topleft), (ColorVal)(left+bottom-bottomleft));
+                        guess[2] = median3(top,bottom,left);
+                    } else {
+                        const bool rightPresent = c+1 < cols;
+                        const ColorVal left = image(p,z,r,c-1);
+                        const ColorVal top = (r>0 ? image(p,z,r-1,c) : left);
+                        const ColorVal topleft = (r>0 ? image(p,z,r-1,c-1) : left);
+                        const ColorVal topright = (r>0 && rightPresent ? image(p,z,r-1,c+1) : top);
+                        const ColorVal right = (rightPresent ? image(p,z,r,c+1) : top);
+                        guess[0] = (left + right)>>1;
+                        guess[1] = median3(guess[0], (ColorVal)(left+top-topleft), (ColorVal)(right+top-topright));
+                        guess[2] = median3(top,left,right);
+                    }
+                    const ColorVal curr = image(p,z,r,c);
+                    for (int predictor = 0; predictor <= MAX_PREDICTOR; predictor++) {
+                        ranges->snap(p,pp[p],min,max,guess[predictor]);
+                        const ColorVal diff = curr - guess[predictor];
+                        cost[p][predictor] += maniac::util::ilog2(abs(diff)) + (diff ? zerobonus : 0);
+                    }
+                }
             }
-          }
-      }
-      //total_size[predictor] = coder.compute_total_size();
+        }
+    }
+}
+
+void estimate_predictor_costs(const Images &images, const ColorRanges *ranges, const int z, const std::vector<bool> &planes,
+                              std::vector<std::vector<uint64_t>> &costs, const int nb_threads, const RowSample &sample) {
+    const int nump = images[0].numPlanes();
+    std::vector<bool> mask(nump, false);
+    for (int p = 0; p < nump && p < (int)planes.size(); p++) mask[p] = planes[p];
+    // bands of rows are estimated in parallel, each into its own totals, so the sums don't depend on the scheduling
+    const uint32_t rows = images[0].rows(z), band = 64;
+    const size_t nb_bands = (rows + band - 1) / band;
+    std::vector<uint64_t> band_costs(nb_bands * 5 * (MAX_PREDICTOR+1), 0);
+    parallel_for(nb_bands, nb_threads, [&](size_t b) {
+        uint64_t (*cost)[MAX_PREDICTOR+1] = reinterpret_cast<uint64_t (*)[MAX_PREDICTOR+1]>(&band_costs[b * 5 * (MAX_PREDICTOR+1)]);
+        estimate_predictor_costs_rows(images, ranges, z, b * band, std::min<uint32_t>(rows, (b + 1) * band), mask, sample, cost);
+    });
+    costs.assign(nump, std::vector<uint64_t>(MAX_PREDICTOR+1, 0));
+    for (size_t b = 0; b < nb_bands; b++)
+        for (int p = 0; p < nump && p < 5; p++)
+            for (int predictor = 0; predictor <= MAX_PREDICTOR; predictor++)
+                costs[p][predictor] += band_costs[(b * 5 + p) * (MAX_PREDICTOR+1) + predictor];
+}
+
+// Picks the predictor with the lowest estimated cost at zoomlevel z for each of the given planes (-1 for the other planes).
+std::vector<int> find_best_predictors(const Images &images, const ColorRanges *ranges, const int z, const std::vector<bool> &planes,
+                                      const int nb_threads, const RowSample &sample = RowSample()) {
+    std::vector<std::vector<uint64_t>> costs;
+    estimate_predictor_costs(images, ranges, z, planes, costs, nb_threads, sample);
+    std::vector<int> best(costs.size(), -1);
+    for (size_t p = 0; p < costs.size(); p++) {
+        if (p >= planes.size() || !planes[p]) continue;
+        best[p] = 0;
+//        costs[p][0] = 9*costs[p][0]/10; // give an advantage to predictor 0, because if it's a close race, then 0 is usually better in the end
+        for (int predictor=0; predictor <= MAX_PREDICTOR; predictor++)
+            if (costs[p][predictor] < costs[p][best[p]])
+                best[p]=predictor;
     }
-    int best = 0;
-//    total_size[0] = 9*total_size[0]/10; // give an advantage to predictor 0, because if it's a close race, then 0 is usually better in the end
-    for (int predictor=0; predictor <= MAX_PREDICTOR; predictor++)
-        if (total_size[predictor] < total_size[best])
-            best=predictor;
     return best;
 }
 
 template<typename IO, typename Rac, typename Coder>
 void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const Images &images,
-                             const ColorRanges *ranges, const int beginZL, const int endZL, flif_options &options, Progress &progress) {
+                             const ColorRanges *ranges, const int beginZL, const int endZL, flif_options &options, Progress &progress, const int only_plane,
+                             TruncationIndex *index, FLIF_STATS *stats, const RowSample &sample) {
     ColorVal min,max;
     const int nump = images[0].numPlanes();
     const bool alphazero = (nump>3 && images[0].alpha_zero_special);
@@ -206,16 +271,42 @@ void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const
     const bool default_order = (options.chroma_subsampling==0);
     metaCoder.write_int(0, 1, (default_order? 1 : 0)); // we're using the default zoomlevel/plane ordering
     for (int p=0; p<nump; p++) metaCoder.write_int(-1, MAX_PREDICTOR, the_predictor[p]);
+    std::vector<std::vector<int>> zoomlevel_predictors(beginZL+1);
     for (int i = 0; i < plane_zoomlevels(images[0], beginZL, endZL); i++) {
       std::pair<int, int> pzl = plane_zoomlevel(images[0], beginZL, endZL, i, ranges);
       int p = pzl.first;
       int z = pzl.second;
       if (options.chroma_subsampling && p > 0 && p < 3 && z < 2) continue;
       if (!default_order) metaCoder.write_int(0, nump-1, p);
+      if (only_plane >= 0 && p != only_plane) continue;
+      // record where the decoder checks its quality and scale targets
+      if (index && endZL == 0) {
+          for (int q = 5; q < 100; q += 5)
+              if (100*index->pixels_done > q*index->pixels_todo && !index->qualities.count(q)) index->qualities[q] = rac.decoder_position();
+      }
       if (ranges->min(p) >= ranges->max(p)) continue;
-      int predictor = (the_predictor[p] < 0 ? find_best_predictor(images, ranges, p, z) : the_predictor[p]);
+      int predictor = the_predictor[p];
+      if (predictor < 0) {
+          // the predictors of all the planes of a zoomlevel are picked together, the first time one of them is needed
+          std::vector<int> &best = zoomlevel_predictors[z];
+          if (best.empty()) {
+              std::vector<bool> planes(nump);
+              for (int q = 0; q < nump; q++)
+                  planes[q] = the_predictor[q] < 0 && ranges->min(q) < ranges->max(q) && (only_plane < 0 || q == only_plane)
+                              && !(options.chroma_subsampling && q > 0 && q < 3 && z < 2);
+              best = find_best_predictors(images, ranges, z, planes, (only_plane < 0 ? options.threads : 1));
+          }
+          predictor = best[p];
+      }
       //if (z < 2 && the_predictor < 0) printf("Plane %i, zoomlevel %i: predictor %i\n",p,z,predictor);
       if (the_predictor[p] < 0) metaCoder.write_int(0, MAX_PREDICTOR, predictor);
+      if (index) {
+          for (int scale = 2; scale <= 128; scale *= 2)
+              if (1<<(z/2) < scale && !index->scales.count(scale)) index->scales[scale] = rac.decoder_position();
+      }
+      const int64_t pixels_before = progress.pixels_done;
+      const long start_pos = rac.decoder_position();
+      const uint64_t start_symbols = coders[p].symbols(), start_visited = coders[p].visited_nodes();
       if (endZL == 0) v_printf_tty(2,"\r%i%% done [%i/%i] ENC[%i,%ux%u]  ",(int)(100*progress.pixels_done/progress.pixels_todo),i,plane_zoomlevels(images[0], beginZL, endZL)-1,p,images[0].cols(z),images[0].rows(z));
       Properties properties((nump>3?NB_PROPERTIESA[p]:NB_PROPERTIES[p]));
       if (z % 2 == 0) {
@@ -223,6 +314,7 @@ void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const
           for (uint32_t r = 1; r < images[0].rows(z); r += 2) {
             progress.pixels_done += images[0].cols(z);
             if (endZL == 0 && (r & 257)==257) v_printf_tty(3,"\r%i%% done [%i/%i] ENC[%i,%ux%u]  ",(int)(100*progress.pixels_done/progress.pixels_todo),i,plane_zoomlevels(images[0], beginZL, endZL)-1,p,images[0].cols(z),images[0].rows(z));
+            if (!sample(r, images[0].rows(z))) continue;
             for (int fr=0; fr<(int)images.size(); fr++) {
               const Image& image = images[fr];
               if (image.seen_before >= 0) { continue; }
@@ -251,6 +343,7 @@ void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const
           for (uint32_t r = 0; r < images[0].rows(z); r++) {
             progress.pixels_done += images[0].cols(z)/2;
             if (endZL == 0 && (r&513)==513) v_printf_tty(3,"\r%i%% done [%i/%i] ENC[%i,%ux%u]  ",(int)(100*progress.pixels_done/progress.pixels_todo),i,plane_zoomlevels(images[0], beginZL, endZL)-1,p,images[0].cols(z),images[0].rows(z));
+            if (!sample(r, images[0].rows(z))) continue;
             for (int fr=0; fr<(int)images.size(); fr++) {
               const Image& image = images[fr];
               if (image.seen_before >= 0) { continue; }
@@ -277,6 +370,8 @@ void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const
             }
           }
       }
+      if (index) index->pixels_done += progress.pixels_done - pixels_before;
+      if (stats) stats->add_symbols(p, z, rac.decoder_position() - start_pos, coders[p].symbols() - start_symbols, coders[p].visited_nodes() - start_visited);
       if (endZL==0 && io.ftell()>fs) {
           v_printf_tty(3,"    wrote %li bytes    ", io.ftell());
           v_printf_tty(5,"\n");
@@ -287,13 +382,14 @@ void flif_encode_FLIF2_inner(IO& io, Rac& rac, std::vector<Coder> &coders, const
 }
 
 template<typename IO, typename Rac, typename Coder>
-void flif_encode_FLIF2_pass(IO& io, Rac &rac, const Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, const int beginZL, const int endZL, int repeats, flif_options &options, Progress &progress) {
+void flif_encode_FLIF2_pass(IO& io, Rac &rac, const Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, const int beginZL, const int endZL, int repeats, flif_options &options, Progress &progress, const int only_plane = -1,
+                            TruncationIndex *index = NULL, FLIF_STATS *stats = NULL, const RowSample &sample = RowSample()) {
     std::vector<Coder> coders;
     coders.reserve(ranges->numPlanes());
     for (int p = 0; p < ranges->numPlanes(); p++) {
         Ranges propRanges;
         initPropRanges(propRanges, *ranges, p);
-        coders.emplace_back(rac, propRanges, forest[p], options.split_threshold, options.cutoff, options.alpha);
+        coders.emplace_back(rac, propRanges, forest[p], sample.scaled(options.split_threshold), options.cutoff, options.alpha);
     }
 
     if (beginZL == images[0].zooms() && endZL>0) {
@@ -304,14 +400,16 @@ void flif_encode_FLIF2_pass(IO& io, Rac &rac, const Images &images, const ColorR
         if (ranges->min(p) < ranges->max(p)) {
             for (const Image& image : images) metaCoder.write_int(ranges->min(p), ranges->max(p), image(p,0,0,0));
             progress.pixels_done++;
+            if (index) index->pixels_done++;
         }
       }
     }
     while(repeats-- > 0) {
-     flif_encode_FLIF2_inner<IO,Rac,Coder>(io, rac, coders, images, ranges, beginZL, endZL, options, progress);
+     flif_encode_FLIF2_inner<IO,Rac,Coder>(io, rac, coders, images, ranges, beginZL, endZL, options, progress, only_plane, index, stats, sample);
     }
     for (int p = 0; p < images[0].numPlanes(); p++) {
-        coders[p].simplify(options.divisor, options.min_size, p);
+        if (only_plane >= 0 && p != only_plane) continue;
+        coders[p].simplify(sample.scaled(options.divisor), sample.scaled(options.min_size), p);
     }
 }
 
@@ -678,8 +776,68 @@ template<typename IO, typename BitChance, typename Rac> void flif_encode_tree(FL
         metacoder.write_tree(forest[p]);
     }
 }
+// Copy of the subtree at pos, leaving out the splits that cannot occur within the given property ranges
+// (a dictionary tree may have been learned on images with other ranges, and a split outside of the range
+// cannot be encoded). Unreachable nodes of the source tree are left out too.
+void fit_subtree(const Tree &tree, const uint32_t pos, Ranges &subrange, Tree &fitted, const uint32_t fpos) {
+    const PropertyDecisionNode &n = tree[pos];
+    if (n.property == -1) return; // fitted[fpos] is a leaf already
+    const int p = n.property;
+    const int oldmin = subrange[p].first;
+    const int oldmax = subrange[p].second;
+    if (n.splitval < oldmin) return fit_subtree(tree, n.childID, subrange, fitted, fpos);
+    if (n.splitval >= oldmax) return fit_subtree(tree, n.childID+1, subrange, fitted, fpos);
+    const uint32_t child = fitted.size();
+    fitted.resize(child+2);
+    fitted[fpos] = PropertyDecisionNode(p, n.splitval, child);
+    fitted[fpos].count = std::min<int>(std::max<int>(n.count, CONTEXT_TREE_MIN_COUNT), CONTEXT_TREE_MAX_COUNT);
+    subrange[p].first = n.splitval+1;
+    fit_subtree(tree, n.childID, subrange, fitted, child);
+    subrange[p].first = oldmin;
+    subrange[p].second = n.splitval;
+    fit_subtree(tree, n.childID+1, subrange, fitted, child+1);
+    subrange[p].second = oldmax;
+}
+
+Tree fit_tree(const Tree &tree, const Ranges &propRanges) {
+    Tree fitted;
+    Ranges subrange(propRanges);
+    fit_subtree(tree, 0, subrange, fitted, 0);
+    return fitted;
+}
+
+void prop_ranges(Ranges &propRanges, const ColorRanges *ranges, const int p, const flifEncoding encoding) {
+    if (encoding == flifEncoding::nonInterlaced) initPropRanges_scanlines(propRanges, *ranges, p);
+    else initPropRanges(propRanges, *ranges, p);
+}
+
+// Learn the MANIAC trees with one thread per plane.
+// The tree of plane p only depends on the symbols of plane p (in their usual order), so the resulting forest
+// is identical to the one learned by the single-threaded passes.
 template <int bits, typename IO>
-void flif_encode_main(RacOut<IO>& rac, IO& io, Images &images, const ColorRanges *ranges, flif_options &options) {
+void flif_encode_learn_threaded(IO& io, const Images &images, const ColorRanges *ranges, std::vector<Tree> &forest, const int roughZL, int learn_repeats, int nb_threads, flif_options &options, Progress &progress, const RowSample &sample) {
+    typedef PropertySymbolCoder<FLIFBitChancePass1, RacDummy, bits> Coder;
+    const flifEncoding encoding = options.method.encoding;
+    std::vector<int> planes;
+    for (int k=0; k < 5; k++) {
+        int p=PLANE_ORDERING[k];
+        if (p < ranges->numPlanes() && ranges->min(p) < ranges->max(p)) planes.push_back(p);
+    }
+    std::vector<Progress> plane_progress(planes.size(), progress);
+    v_printf(4,"Learning the MANIAC trees of %i planes in parallel.\n", (int)planes.size());
+    parallel_for(planes.size(), nb_threads, [&](size_t i) {
+        RacDummy dummy;
+        if (encoding == flifEncoding::nonInterlaced)
+            flif_encode_scanlines_pass<IO, RacDummy, Coder>(io, dummy, images, ranges, forest, learn_repeats, options, plane_progress[i], planes[i], NULL, sample);
+        else
+            flif_encode_FLIF2_pass<IO, RacDummy, Coder>(io, dummy, images, ranges, forest, roughZL, 0, learn_repeats, options, plane_progress[i], planes[i], NULL, NULL, sample);
+    });
+    const int64_t start = progress.pixels_done;
+    for (const Progress &pp : plane_progress) progress.pixels_done += pp.pixels_done - start;
+}
+
+template <int bits, typename IO>
+void flif_encode_main(RacOut<IO>& rac, IO& io, Images &images, const ColorRanges *ranges, flif_options &options, TruncationIndex *index) {
 
     flifEncoding encoding = options.method.encoding;
     int learn_repeats = options.learn_repeats;
@@ -693,6 +851,7 @@ void flif_encode_main(RacOut<IO>& rac, IO& io, Images &images, const ColorRanges
             progress.pixels_todo -= (image.rows()*image.cols()-image.rows(2)*image.cols(2))*(learn_repeats+1);
     progress.pixels_done = 0;
     if (progress.pixels_todo == 0) progress.pixels_todo = progress.pixels_done = 1;
+    if (index) index->pixels_todo = std::max<int64_t>(image.rows()*image.cols()*realnumplanes, 1);
 
     // two passes
     std::vector<Tree> forest(ranges->numPlanes(), Tree());
@@ -708,38 +867,82 @@ void flif_encode_main(RacOut<IO>& rac, IO& io, Images &images, const ColorRanges
       //v_printf(2,"Encoding rough data\n");
       UniformSymbolCoder<RacOut<IO>> metaCoder(rac);
       metaCoder.write_int(0,image.zooms(),roughZL);
-      flif_encode_FLIF2_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, image.zooms(), roughZL+1, 1, options, progress);
+      PhaseTimer timer(PHASE_ROUGH_PASS, options.stats);
+      flif_encode_FLIF2_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, image.zooms(), roughZL+1, 1, options, progress, -1, index, options.stats);
+    }
+
+    const RowSample sample = learning_sample(images, options);
+    if (sample.keep < 16 && learn_repeats > 0) v_printf(3,"Learning from %i/16 of the rows.\n", sample.keep);
+
+    // start from the dictionary trees (only now: the rough data is coded without a tree)
+    ForestDictionary *dictionary = options.dictionary;
+    if (dictionary) {
+        const std::vector<Tree> &trees = dictionary->forest(encoding, ranges->numPlanes());
+        for (int p = 0; p < ranges->numPlanes() && p < (int)trees.size(); p++) {
+            Ranges propRanges;
+            prop_ranges(propRanges, ranges, p, encoding);
+            forest[p] = fit_tree(trees[p], propRanges);
+            // simplifying the trees after learning divides the counts again
+            if (learn_repeats > 0)
+                for (PropertyDecisionNode &n : forest[p])
+                    if (n.property != -1) n.count = std::min<int64_t>((int64_t)n.count * sample.scaled(options.divisor), INT16_MAX);
+        }
+        if (!trees.empty()) v_printf(3,"Starting from the dictionary trees.\n");
     }
 
     //v_printf(2,"Encoding data (pass 1)\n");
     if (learn_repeats>0) v_printf(3,"Learning a MANIAC tree. Iterating %i time%s.\n",learn_repeats,(learn_repeats>1?"s":""));
+    int nb_threads = options.threads;
+    if (nb_threads <= 0) nb_threads = std::thread::hardware_concurrency();
+    if (learn_repeats > 0 || !dictionary) {
+    PhaseTimer timer(PHASE_LEARN, options.stats);
+    if (learn_repeats > 0 && nb_threads > 1 && realnumplanes > 1) {
+        flif_encode_learn_threaded<bits, IO>(io, images, ranges, forest, roughZL, learn_repeats, nb_threads, options, progress, sample);
+    } else
     switch(encoding) {
         case flifEncoding::nonInterlaced:
-           flif_encode_scanlines_pass<IO, RacDummy, PropertySymbolCoder<FLIFBitChancePass1, RacDummy, bits> >(io, dummy, images, ranges, forest, learn_repeats, options, progress);
+           flif_encode_scanlines_pass<IO, RacDummy, PropertySymbolCoder<FLIFBitChancePass1, RacDummy, bits> >(io, dummy, images, ranges, forest, learn_repeats, options, progress, -1, NULL, sample);
            break;
         case flifEncoding::interlaced:
-           flif_encode_FLIF2_pass<IO, RacDummy, PropertySymbolCoder<FLIFBitChancePass1, RacDummy, bits> >(io, dummy, images, ranges, forest, roughZL, 0, learn_repeats, options, progress);
+           flif_encode_FLIF2_pass<IO, RacDummy, PropertySymbolCoder<FLIFBitChancePass1, RacDummy, bits> >(io, dummy, images, ranges, forest, roughZL, 0, learn_repeats, options, progress, -1, NULL, NULL, sample);
            break;
     }
+    }
     v_printf_tty(3,"\r");
+    if (dictionary && dictionary->training) {
+        std::vector<Tree> &trees = dictionary->forest(encoding, ranges->numPlanes());
+        trees.resize(std::max<size_t>(trees.size(), ranges->numPlanes()));
+        for (int p = 0; p < ranges->numPlanes(); p++) {
+            if (ranges->min(p) >= ranges->max(p)) continue;
+            Ranges propRanges;
+            prop_ranges(propRanges, ranges, p, encoding);
+            trees[p] = fit_tree(forest[p], propRanges);
+        }
+        return; // the trees are all the trainer needs
+    }
     v_printf(3,"Header: %li bytes.", fs);
     if (encoding==flifEncoding::interlaced) v_printf(3," Rough data: %li bytes.", io.ftell()-fs);
     fflush(stdout);
 
     //v_printf(2,"Encoding tree\n");
     fs = io.ftell();
+    if (options.stats) options.stats->set_forest(forest);
+    {
+    PhaseTimer timer(PHASE_TREE, options.stats);
     flif_encode_tree<IO, FLIFBitChanceTree, RacOut<IO>>(io, rac, ranges, forest, encoding);
+    }
     v_printf(3," MANIAC tree: %li bytes.\n", io.ftell()-fs);
     options.divisor=0;
     options.min_size=0;
     options.split_threshold=0;
     //v_printf(2,"Encoding data (pass 2)\n");
+    PhaseTimer timer(PHASE_FINAL_PASS, options.stats);
     switch(encoding) {
         case flifEncoding::nonInterlaced:
-           flif_encode_scanlines_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, 1, options, progress);
+           flif_encode_scanlines_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, 1, options, progress, -1, options.stats);
            break;
         case flifEncoding::interlaced:
-           flif_encode_FLIF2_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, roughZL, 0, 1, options, progress);
+           flif_encode_FLIF2_pass<IO, RacOut<IO>, FinalPropertySymbolCoder<FLIFBitChancePass2, RacOut<IO>, bits> >(io, rac, images, ranges, forest, roughZL, 0, 1, options, progress, -1, index, options.stats);
            break;
     }
 
@@ -765,14 +968,90 @@ void write_chunk(IO& io, MetaData& metadata) {
     io.fputs(metadata.name);
     unsigned long length = metadata.length;
     write_big_endian_varint(io, length);
-    for(unsigned long i = 0; i < length; i++) {
-        io.fputc(metadata.contents[i]);
+    io.fwrite(metadata.contents.data(), length);
+}
+
+// copy a rectangle of every frame (used to encode the image in tiles)
+Images crop_images(const Images &images, const uint32_t x0, const uint32_t y0, const uint32_t w, const uint32_t h) {
+    Images cropped;
+    for (const Image& image : images) {
+        cropped.push_back(Image(w, h, image.min(0), image.max(0), image.numPlanes()));
+        Image& tile = cropped.back();
+        tile.alpha_zero_special = image.alpha_zero_special;
+        tile.frame_delay = image.frame_delay;
+        for (int p = 0; p < image.numPlanes(); p++)
+            for (uint32_t r = 0; r < h; r++)
+                for (uint32_t c = 0; c < w; c++)
+                    tile.set(p, r, c, image(p, y0+r, x0+c));
     }
+    return cropped;
 }
 
+// Tiled FLIF: the header is followed by a critical "TILE" chunk containing the tile dimensions and the
+// length of every tile. Each tile is a complete FLIF file (without metadata), so tiles can be encoded
+// and decoded independently of one another.
+template <typename IO>
+bool flif_encode_tiles(IO& io, const Images &images, const std::vector<std::string> &transDesc, flif_options &options) {
+    const uint32_t width = images[0].cols(), height = images[0].rows();
+    const uint32_t tile_w = options.tile_size, tile_h = options.tile_size;
+    const uint32_t nx = (width-1)/tile_w+1, ny = (height-1)/tile_h+1;
+    v_printf(2,"Encoding %u tiles of %ux%u\n", nx*ny, tile_w, tile_h);
+
+    std::vector<std::vector<uint8_t>> tiles(nx*ny);
+    std::vector<char> ok(nx*ny, false);
+    std::mutex stats_mutex;
+    parallel_for(tiles.size(), options.threads, [&](size_t i) {
+        const uint32_t x0 = (i % nx) * tile_w, y0 = (i / nx) * tile_h;
+        Images tile = crop_images(images, x0, y0, std::min(tile_w, width-x0), std::min(tile_h, height-y0));
+        flif_options tile_options = options;
+        tile_options.tile_size = 0;
+        tile_options.truncation_index = 0;
+        if (tiles.size() > 1) tile_options.threads = 1; // the tiles already keep the cores busy
+        FLIF_STATS tile_stats;
+        tile_options.stats = (options.stats ? &tile_stats : NULL);
+        BlobIO bio;
+        const bool tile_ok = flif_encode(bio, tile, transDesc, tile_options);
+        if (options.stats) {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            options.stats->merge(tile_stats);
+        }
+        if (!tile_ok) return;
+        const size_t length = bio.ftell();
+        size_t size;
+        uint8_t *data = bio.release(&size);
+        tiles[i].assign(data, data+length);
+        delete [] data;
+        ok[i] = true;
+    });
+    for (char tile_ok : ok) if (!tile_ok) { e_printf("Could not encode all tiles.\n"); return false; }
+    if (options.stats) for (const Image &image : images) options.stats->peak_plane_memory += image.plane_memory();
+
+    BlobIO contents;
+    write_big_endian_varint(contents, tile_w - 1);
+    write_big_endian_varint(contents, tile_h - 1);
+    for (const std::vector<uint8_t> &tile : tiles) write_big_endian_varint(contents, tile.size());
+    MetaData chunk;
+    strcpy(chunk.name, "TILE");
+    chunk.length = contents.ftell();
+    size_t size;
+    uint8_t *data = contents.release(&size);
+    chunk.contents.assign(data, data+chunk.length);
+    delete [] data;
+    write_chunk(io, chunk);
+
+    // marker to indicate FLIF version (version 0 aka FLIF16 in this case)
+    io.fputc(0);
+
+    for (const std::vector<uint8_t> &tile : tiles) io.fwrite(tile.data(), tile.size());
+    io.flush();
+
+    v_printf_tty(2,"\r");
+    v_printf(2,"Wrote output FLIF file %s, %li bytes for %ux%u pixels in %u tiles (%.4fbpp)   \n",io.getName(),io.ftell(), width, height, nx*ny, 8.0*io.ftell()/height/width/images.size());
+    return true;
+}
 
 template <typename IO>
-bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options) {
+bool flif_encode_image(IO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options, TruncationIndex *index) {
 
     flifEncoding encoding = options.method.encoding;
 
@@ -785,6 +1064,9 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
     }
 #endif
 
+    // the transforms and encoding passes below write to the images from several threads
+    for (Image& image : images) image.own_planes();
+
     bool adaptive = (options.loss<0);
     Image adaptive_map;
     if (adaptive) { // images[0] is the still image to be encoded, images[1] is the saliency map for adaptive lossy
@@ -795,6 +1077,10 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
         images.pop_back();
     }
 
+    const bool tiled = (options.tile_size > 0 && !options.just_add_loss
+                        && (images[0].cols() > (uint32_t)options.tile_size || images[0].rows() > (uint32_t)options.tile_size));
+    if (tiled && adaptive) { e_printf("Adaptive lossy compression cannot be combined with tiles.\n"); return false; }
+
 
     io.fputs("FLIF");  // bytes 1-4 are fixed magic
     // byte 5 encodes color type, interlacing, animation
@@ -841,8 +1127,11 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
             v_printf(3,"Encoded metadata chunk: %s\n",images[0].metadata[i].name);
     }
 
+    if (tiled) return flif_encode_tiles(io, images, transDesc, options);
+
     // marker to indicate FLIF version (version 0 aka FLIF16 in this case)
     io.fputc(0);
+    if (index) index->data_start = io.ftell();
 
 
     RacOut<IO> rac(io);
@@ -891,6 +1180,7 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
     if (images[0].palette) options.crc_check = false;
     if (options.crc_check && !options.loss) {
       if (alphazero) for (Image& i : images) i.make_invisible_rgb_black();
+      PhaseTimer timer(PHASE_CHECKSUM, options.stats);
       checksum = image.checksum(); // if there are multiple frames, the checksum is based only on the first frame.
     }
 
@@ -900,6 +1190,17 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
     v_printf(3,"Transforms: ");
 
     std::vector<std::unique_ptr<Transform<IO>>> transforms;
+    // row-wise transforms whose data() has not been applied yet; they are done together in one pass over the image
+    std::vector<std::unique_ptr<Transform<IO>>> pending;
+    auto apply_pending = [&]() {
+        if (pending.empty()) return;
+        PhaseTimer timer(PHASE_TRANSFORM_DATA, options.stats);
+        std::vector<const Transform<IO>*> steps;
+        for (auto &t : pending) steps.push_back(t.get());
+        data_rows(steps, images, options.threads);
+        if (options.just_add_loss) for (auto &t : pending) transforms.push_back(std::move(t));
+        pending.clear();
+    };
 
     int warn_about_incompatibility = 0;
     try {
@@ -911,9 +1212,15 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
         if (transDesc[i] == "Frame_Lookback") trans->configure(options.lookback);
 #endif
         if (transDesc[i] == "PermutePlanes") trans->configure(options.subtract_green);
-        if (!trans->init(previous_range) ||
-            (!trans->process(previous_range, images)
-              && !(options.acb==1 && transDesc[i] == "Color_Buckets" && (v_printf(3,", forced "), (tcount=0), true) ))) {
+        bool ok;
+        if (trans->process_reads_pixels()) apply_pending();
+        {
+            PhaseTimer timer(PHASE_TRANSFORM_PROCESS, options.stats);
+            ok = trans->init(previous_range) &&
+                 (trans->process(previous_range, images)
+                  || (options.acb==1 && transDesc[i] == "Color_Buckets" && (v_printf(3,", forced "), (tcount=0), true)));
+        }
+        if (!ok) {
             //e_printf( "Transform '%s' failed\n", transDesc[i].c_str());
             if (images[0].palette && transDesc[i] == "Palette_Alpha" && options.keep_palette) {
                 v_printf(2,"Could not keep palette for some reason. Aborting.\n");
@@ -927,14 +1234,22 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
             write_name(rac, transDesc[i]);
             trans->save(previous_range, rac);
             fflush(stdout);
-            rangesList.push_back(std::unique_ptr<const ColorRanges>(trans->meta(images, previous_range)));
-            trans->data(images);
             if (transDesc[i] == "Color_Buckets") warn_about_incompatibility = 1;
             if (warn_about_incompatibility && (transDesc[i] == "Frame_Lookback" || transDesc[i] == "Duplicate_Frame" || transDesc[i] == "Frame_Shape"))
                 warn_about_incompatibility = 2;
+            if (trans->is_row_wise()) {
+                rangesList.push_back(std::unique_ptr<const ColorRanges>(trans->meta(images, previous_range)));
+                pending.push_back(std::move(trans));
+                continue;
+            }
+            apply_pending();
+            PhaseTimer timer(PHASE_TRANSFORM_DATA, options.stats);
+            rangesList.push_back(std::unique_ptr<const ColorRanges>(trans->meta(images, previous_range)));
+            trans->data(images);
             if (options.just_add_loss) transforms.push_back(std::move(trans));
         }
       }
+      apply_pending();
     } catch (std::bad_alloc&) {
          e_printf("Error: could not allocate enough memory for transforms. Aborting. Try -E0.\n");
          return false;
@@ -942,6 +1257,7 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
     if (tcount==0) v_printf(3,"none\n"); else v_printf(3,"\n");
     if (warn_about_incompatibility > 1) v_printf(1,"WARNING: This animated FLIF will probably not be properly decoded by older FLIF decoders (version < 0.3) since they have a bug in this particular combination of transformations.\nIf backwards compatibility is important, you can use the option -B to avoid the issue.\n");
     rac.write_bit(false);
+    if (options.stats) options.stats->update_memory(images);
     const ColorRanges* ranges = rangesList.back().get();
 
     for (int p = 0; p < ranges->numPlanes(); p++) {
@@ -1019,13 +1335,19 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
           }
           if (autodetect) {
            v_printf(3,"  ->  -G");
+           // all planes are estimated together, first at zoomlevel 1 and then at zoomlevel 0 for the planes that need it
+           const RowSample sample = learning_sample(images, options);
+           std::vector<bool> planes(ranges->numPlanes());
+           for(int p=0; p<ranges->numPlanes(); p++) planes[p] = (options.predictor[p] == -2 && ranges->min(p) < ranges->max(p));
+           const std::vector<int> best1 = find_best_predictors(images, ranges, 1, planes, options.threads, sample);
+           // predictor 0 is usually the safest choice, so only pick a different one if it's the best at zoomlevel 0 too
+           bool check0 = false;
+           for(int p=0; p<ranges->numPlanes(); p++) check0 |= (planes[p] = (best1[p] > 0));
+           std::vector<int> best0;
+           if (check0) best0 = find_best_predictors(images, ranges, 0, planes, options.threads, sample);
            for(int p=0; p<ranges->numPlanes(); p++) {
             if (options.predictor[p] == -2) {
-              if (ranges->min(p) < ranges->max(p)) {
-                options.predictor[p] = find_best_predictor(images, ranges, p, 1);
-                // predictor 0 is usually the safest choice, so only pick a different one if it's the best at zoomlevel 0 too
-                if (options.predictor[p] > 0 && find_best_predictor(images, ranges, p, 0) != options.predictor[p]) options.predictor[p] = 0;
-              } else options.predictor[p] = 0;
+              options.predictor[p] = (best1[p] > 0 && best0[p] == best1[p] ? best1[p] : 0);
             }
             if (options.predictor[p] >= 0) v_printf(3,"%i",options.predictor[p]);
             else if (options.predictor[p] == -1) v_printf(3,"X");
@@ -1037,10 +1359,10 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
 
 
     if (bits ==10) {
-      flif_encode_main<10>(rac, io, images, ranges, options);
+      flif_encode_main<10>(rac, io, images, ranges, options, index);
 #ifdef SUPPORT_HDR
     } else {
-      flif_encode_main<18>(rac, io, images, ranges, options);
+      flif_encode_main<18>(rac, io, images, ranges, options, index);
 #endif
     }
 
@@ -1067,8 +1389,211 @@ bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDe
     return true;
 }
 
+std::vector<std::string> choose_transforms(Images &images, flif_options &options) {
+    bool flat=true;
+    for (Image &image : images) if (image.uses_alpha()) flat=false;
+    if (flat && images[0].numPlanes() == 4) {
+        v_printf(2,"Alpha channel not actually used, dropping it.\n");
+        for (Image &image : images) image.drop_alpha();
+    }
+    bool grayscale=true;
+    for (Image &image : images) if (image.uses_color()) grayscale=false;
+    if (grayscale && images[0].numPlanes() == 3) {
+        v_printf(2,"Chroma not actually used, dropping it.\n");
+        for (Image &image : images) image.drop_color();
+    }
+    uint64_t nb_pixels = (uint64_t)images[0].rows() * images[0].cols();
+    std::vector<std::string> desc;
+    if (nb_pixels > 2) {         // no point in doing anything for 1- or 2-pixel images
+      if (options.plc && (images[0].getDepth() > 8 || !options.loss)) {
+        desc.push_back("Channel_Compact");  // compactify channels (not if lossy, because then loss gets magnified!)
+      }
+      if (options.ycocg) {
+        desc.push_back("YCoCg");  // convert RGB(A) to YCoCg(A)
+      }
+      desc.push_back("PermutePlanes");  // permute RGB to GRB
+      desc.push_back("Bounds");  // get the bounds of the color spaces
+    }
+    // only use palette/CB if we're lossless, because lossy and palette don't go well together...
+    if (options.palette_size == -1) {
+        options.palette_size = DEFAULT_MAX_PALETTE_SIZE;
+        if (nb_pixels * images.size() / 3 < DEFAULT_MAX_PALETTE_SIZE) {
+          options.palette_size = nb_pixels * images.size() / 3;
+        }
+    }
+    if (!options.loss && options.palette_size != 0) {
+        desc.push_back("Palette_Alpha");  // try palette (including alpha)
+        desc.push_back("Palette");  // try palette (without alpha)
+    }
+    if (!options.loss) {
+    if (options.acb == -1) {
+      // not specified if ACB should be used
+      if (nb_pixels * images.size() > 10000) {
+        desc.push_back("Color_Buckets");  // try auto color buckets on large images
+      }
+    } else if (options.acb) {
+      desc.push_back("Color_Buckets");  // try auto color buckets if forced
+    }
+    }
+    if (options.method.o == Optional::undefined) {
+        // no method specified, pick one heuristically
+        if (nb_pixels * images.size() < 10000) options.method.encoding=flifEncoding::nonInterlaced; // if the image is small, not much point in doing interlacing
+        else options.method.encoding=flifEncoding::interlaced; // default method: interlacing
+    }
+    if (images.size() > 1) {
+        desc.push_back("Duplicate_Frame");  // find duplicate frames
+        if (!options.loss) { // only if lossless
+          if (options.frs) desc.push_back("Frame_Shape");  // get the shapes of the frames
+          if (options.lookback) desc.push_back("Frame_Lookback");  // make a "deep" alpha channel (negative values are transparent to some previous frame)
+        }
+    }
+    if (options.learn_repeats < 0) {
+        // no number of repeats specified, pick a number heuristically
+        options.learn_repeats = TREE_LEARN_REPEATS;
+        // starting from pretrained trees, one refinement pass is enough
+        if (options.dictionary && !options.dictionary->training) options.learn_repeats = 1;
+        //if (nb_pixels * images.size() < 5000) learn_repeats--;        // avoid large trees for small images
+        if (options.learn_repeats < 0) options.learn_repeats=0;
+    }
+    return desc;
+}
+
+// Dictionary file: "FLIFdict", a version byte, then for every encoding method and property layout the number
+// of trees, each tree being its number of nodes followed by the nodes (little-endian property, count, splitval, childID).
+static const char DICTIONARY_MAGIC[8] = {'F','L','I','F','d','i','c','t'};
+static const int DICTIONARY_VERSION = 1;
+static const uint32_t DICTIONARY_MAX_NODES = 1<<20;
+
+static void write_le(FILE *f, uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) fputc((v >> (8*i)) & 0xFF, f);
+}
+
+static bool read_le(FILE *f, uint32_t &v, int bytes) {
+    v = 0;
+    for (int i = 0; i < bytes; i++) {
+        int c = fgetc(f);
+        if (c == EOF) return false;
+        v |= (uint32_t)c << (8*i);
+    }
+    return true;
+}
+
+static int dictionary_nb_properties(int interlaced, int alpha, int p) {
+    if (interlaced) return (alpha ? NB_PROPERTIESA[p] : NB_PROPERTIES[p]);
+    return (alpha ? NB_PROPERTIES_scanlinesA[p] : NB_PROPERTIES_scanlines[p]);
+}
+
+bool ForestDictionary::save(const char *filename) const {
+    FILE *f = fopen(filename, "wb");
+    if (!f) { e_printf("Could not write dictionary file: %s\n", filename); return false; }
+    fwrite(DICTIONARY_MAGIC, 1, sizeof(DICTIONARY_MAGIC), f);
+    fputc(DICTIONARY_VERSION, f);
+    for (int e = 0; e < 2; e++) for (int a = 0; a < 2; a++) {
+        fputc(forests[e][a].size(), f);
+        for (const Tree &tree : forests[e][a]) {
+            write_le(f, tree.size(), 4);
+            for (const PropertyDecisionNode &n : tree) {
+                write_le(f, (uint8_t)n.property, 1);
+                write_le(f, (uint16_t)n.count, 2);
+                write_le(f, (uint32_t)(int32_t)n.splitval, 4);
+                write_le(f, n.childID, 4);
+            }
+        }
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) || !ok) { e_printf("Could not write dictionary file: %s\n", filename); return false; }
+    return true;
+}
+
+bool ForestDictionary::load(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) { e_printf("Could not open dictionary file: %s\n", filename); return false; }
+    char magic[sizeof(DICTIONARY_MAGIC)];
+    bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, DICTIONARY_MAGIC, sizeof(magic))
+              && fgetc(f) == DICTIONARY_VERSION;
+    for (int e = 0; ok && e < 2; e++) for (int a = 0; ok && a < 2; a++) {
+        uint32_t nb_trees;
+        ok = read_le(f, nb_trees, 1) && nb_trees <= 5;
+        std::vector<Tree> &trees = forests[e][a];
+        trees.assign(ok ? nb_trees : 0, Tree());
+        for (int p = 0; ok && p < (int)nb_trees; p++) {
+            uint32_t size;
+            ok = read_le(f, size, 4) && size >= 1 && size <= DICTIONARY_MAX_NODES;
+            if (ok) trees[p].resize(size);
+            for (uint32_t i = 0; ok && i < size; i++) {
+                uint32_t property, count, splitval, childID;
+                ok = read_le(f, property, 1) && read_le(f, count, 2) && read_le(f, splitval, 4) && read_le(f, childID, 4);
+                PropertyDecisionNode &n = trees[p][i];
+                n.property = (int8_t)property;
+                n.count = (int16_t)count;
+                n.splitval = (int32_t)splitval;
+                n.childID = childID;
+                n.leafID = 0;
+                if (!ok || n.property == -1) continue;
+                // children come after their parent, so the tree cannot contain cycles
+                ok = n.property >= 0 && n.property < dictionary_nb_properties(e, a, p)
+                     && n.splitval == (int32_t)splitval && childID > i && childID < size-1;
+            }
+        }
+    }
+    fclose(f);
+    if (!ok) { e_printf("Not a valid dictionary file: %s\n", filename); return false; }
+    return true;
+}
+
+// Truncation index: encode to memory first, then insert the "tRnc" chunk with the offsets right before the
+// image data. The image data itself is identical to what is written without the index.
+template <typename IO>
+bool flif_encode_indexed(IO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options) {
+    BlobIO bio;
+    TruncationIndex index;
+    if (!flif_encode_image(bio, images, transDesc, options, &index)) return false;
+    const size_t length = bio.ftell();
+    size_t size;
+    uint8_t *data = bio.release(&size);
+    size_t pos = 0;
+    if (index.scales.empty()) {
+        v_printf(1,"Warning: not writing a truncation index (only possible for interlaced images without tiles).\n");
+    } else {
+        BlobIO contents;
+        write_big_endian_varint(contents, index.scales.size());
+        for (const auto &s : index.scales) {
+            write_big_endian_varint(contents, ilog2(s.first));
+            write_big_endian_varint(contents, s.second - index.data_start);
+        }
+        write_big_endian_varint(contents, index.qualities.size());
+        for (const auto &q : index.qualities) {
+            write_big_endian_varint(contents, q.first);
+            write_big_endian_varint(contents, q.second - index.data_start);
+        }
+        MetaData chunk;
+        strcpy(chunk.name, "tRnc");
+        chunk.length = contents.ftell();
+        size_t csize;
+        uint8_t *cdata = contents.release(&csize);
+        chunk.contents.assign(cdata, cdata+chunk.length);
+        delete [] cdata;
+
+        // everything up to the FLIF version marker, then the index chunk
+        pos = index.data_start - 1;
+        io.fwrite(data, pos);
+        write_chunk(io, chunk);
+        v_printf(3,"Encoded truncation index: %i scales, %i quality levels\n", (int)index.scales.size(), (int)index.qualities.size());
+    }
+    io.fwrite(data + pos, length - pos);
+    delete [] data;
+    io.flush();
+    return true;
+}
+
+template <typename IO>
+bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options) {
+    if (options.truncation_index && !options.just_add_loss) return flif_encode_indexed(io, images, transDesc, options);
+    return flif_encode_image(io, images, transDesc, options, NULL);
+}
 
 template bool flif_encode(FileIO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options);
 template bool flif_encode(BlobIO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options);
+template bool flif_encode(SinkIO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options);
 
 #endif
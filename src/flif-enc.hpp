@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "image/color_range.hpp"
 #include "transform/factory.hpp"
 #include "common.hpp"
@@ -7,6 +9,51 @@
 template <typename IO>
 bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDesc, flif_options &options);
 
+// Drops unused alpha/chroma planes and picks the transforms to try (and the options that are still undecided)
+// the way the flif tool does by default.
+std::vector<std::string> choose_transforms(Images &images, flif_options &options);
+
+// Deterministic subset of the rows that the learning passes visit: the first keep bands out of every 16 bands of 8 rows.
+// Zoomlevels of at most 256 rows are always visited completely.
+struct RowSample {
+    int keep;
+    explicit RowSample(int k = 16) : keep(k) {}
+    bool operator()(const uint32_t r, const uint32_t rows) const {
+        return keep >= 16 || rows <= 256 || (int)((r >> 3) & 15) < keep;
+    }
+    // the tree learning parameters that count symbols or bits are scaled down with the sample
+    int scaled(const int x) const { return (x <= 0 ? x : std::max<int64_t>(1, (int64_t)x * keep / 16)); }
+};
+
+
+// The rows the tree learning (and the predictor estimate) use for these images:
+// big images are sampled down to about sqrt(learn_sample * pixels) pixels.
+RowSample learning_sample(const Images &images, const flif_options &options);
+
+// Cheap entropy estimate of zoomlevel z: costs[p][predictor] is the sum, over the pixels of plane p, of the number of
+// significant bits of the residual (plus one if it is nonzero) with the given interlaced predictor.
+// All the requested planes are estimated in one pass over the image, using up to nb_threads threads.
+// The costs of the planes that are not requested are zero.
+void estimate_predictor_costs(const Images &images, const ColorRanges *ranges, const int z, const std::vector<bool> &planes,
+                              std::vector<std::vector<uint64_t>> &costs, const int nb_threads, const RowSample &sample = RowSample());
+
+// Pretrained MANIAC trees. The encoder starts learning from these trees instead of from scratch, so for images
+// that resemble the training corpus one refinement pass (-R1) or none at all (-R0) is enough.
+// The trees are written to the FLIF file as usual, so decoding does not need the dictionary.
+struct ForestDictionary {
+    // trees per encoding method (non-interlaced, interlaced) and property layout (without, with alpha plane)
+    std::vector<Tree> forests[2][2];
+    // while training, the encoder only learns the trees of an image and stores them here
+    bool training;
+
+    ForestDictionary() : training(false) {}
+    std::vector<Tree> & forest(const flifEncoding encoding, const int nump) {
+        return forests[encoding == flifEncoding::interlaced][nump > 3];
+    }
+    bool load(const char *filename);
+    bool save(const char *filename) const;
+};
+
 template <typename IO>
 bool flif_encode(IO& io, Images &images, const std::vector<std::string> &transDesc =
                  {"YCoCg","Bounds","Palette_Alpha","Palette","Color_Buckets","Duplicate_Frame","Frame_Shape","Frame_Lookback"}) {
@@ -26,6 +26,7 @@
 
 #include <string>
 #include <string.h>
+#include <limits.h>
 
 #include "maniac/rac.hpp"
 #include "maniac/compound.hpp"
@@ -82,6 +83,7 @@ void show_help(int mode) {
     v_printf(2,"   -p, --no-color-profile      strip ICC color profile (default is to keep it)\n");
     v_printf(2,"   -o, --overwrite             overwrite existing files\n");
     v_printf(2,"   -k, --keep-palette          use input PNG palette / write palette PNG if possible\n");
+    v_printf(2,"   -j, --threads=N             number of threads (MANIAC learning, tiles); default: -j0 (one per core)\n");
 #ifdef HAS_ENCODER
     if (mode != 1) {
     v_printf(1,"Encode options: (-e, --encode)\n");
@@ -102,6 +104,11 @@ void show_help(int mode) {
     v_printf(2,"   -S, --no-frame-shape        disable Frame_Shape transform\n");
     v_printf(2,"   -L, --max-frame-lookback=N  max nb of frames for Frame_Lookback; default: -L1\n");
     v_printf(2,"   -R, --maniac-repeats=N      MANIAC learning iterations; default: -R%i\n",TREE_LEARN_REPEATS);
+    v_printf(2,"   -a, --maniac-sample=N       learn from a sample of the rows for images above N megapixels (0=never); default: -a%i\n",TREE_LEARN_SAMPLE_MEGAPIXELS);
+    v_printf(2,"   -O, --tile-size=N           split the image in independently coded NxN tiles (N multiple of 64); default: -O0 (no tiles)\n");
+    v_printf(2,"   -z, --truncation-index      store the truncation offsets for -s/-q decodes, to allow flif -x\n");
+    v_printf(2,"   -l, --dictionary=FILE       start from the pretrained MANIAC trees in FILE; implies -R1 unless -R is given\n");
+    v_printf(2,"   -u, --make-dictionary=FILE  learn MANIAC trees over the input images and write them to FILE\n");
     v_printf(3,"   -T, --maniac-threshold=N    MANIAC tree growth split threshold, in bits saved; default: -T%i\n",CONTEXT_TREE_SPLIT_THRESHOLD/5461);
     v_printf(3,"   -D, --maniac-divisor=N      MANIAC inner node count divisor; default: -D%i\n",CONTEXT_TREE_COUNT_DIV);
     v_printf(3,"   -M, --maniac-min-size=N     MANIAC post-pruning threshold; default: -M%i\n",CONTEXT_TREE_MIN_SUBTREE_SIZE);
@@ -121,7 +128,10 @@ void show_help(int mode) {
     v_printf(1,"   -s, --scale=N              lossy downscaled image at scale 1:N (2,4,8,16,32); default -s1\n");
     v_printf(1,"   -r, --resize=WxH           lossy downscaled image to fit inside WxH (but typically smaller)\n");
     v_printf(1,"   -f, --fit=WxH              lossy downscaled image to exactly WxH\n");
+    v_printf(1,"   -g, --crop=WxH+X+Y         only the WxH pixels at offset X,Y (still images)\n");
     v_printf(2,"   -b, --breakpoints          report breakpoints (truncation offsets) for truncations at scales 1:8, 1:4, 1:2\n");
+    v_printf(2,"   -x, --truncate             write the part of <input.flif> needed for -s/-q to <output.flif>, without decoding\n");
+    v_printf(2,"                              (only for files encoded with --truncation-index)\n");
     }
 }
 
@@ -271,71 +281,9 @@ bool encode_load_input_images(int argc, char **argv, Images &images, flif_option
 }
 
 bool encode_flif(FLIF_UNUSED(int argc), char **argv, Images &images, flif_options &options) {
-    bool flat=true;
     unsigned int framenb=0;
     for (Image& i : images) { i.frame_delay = options.frame_delay[framenb]; if (framenb+1 < options.frame_delay.size()) framenb++; }
-    for (Image &image : images) if (image.uses_alpha()) flat=false;
-    if (flat && images[0].numPlanes() == 4) {
-        v_printf(2,"Alpha channel not actually used, dropping it.\n");
-        for (Image &image : images) image.drop_alpha();
-    }
-    bool grayscale=true;
-    for (Image &image : images) if (image.uses_color()) grayscale=false;
-    if (grayscale && images[0].numPlanes() == 3) {
-        v_printf(2,"Chroma not actually used, dropping it.\n");
-        for (Image &image : images) image.drop_color();
-    }
-    uint64_t nb_pixels = (uint64_t)images[0].rows() * images[0].cols();
-    std::vector<std::string> desc;
-    if (nb_pixels > 2) {         // no point in doing anything for 1- or 2-pixel images
-      if (options.plc && (images[0].getDepth() > 8 || !options.loss)) {
-        desc.push_back("Channel_Compact");  // compactify channels (not if lossy, because then loss gets magnified!)
-      }
-      if (options.ycocg) {
-        desc.push_back("YCoCg");  // convert RGB(A) to YCoCg(A)
-      }
-      desc.push_back("PermutePlanes");  // permute RGB to GRB
-      desc.push_back("Bounds");  // get the bounds of the color spaces
-    }
-    // only use palette/CB if we're lossless, because lossy and palette don't go well together...
-    if (options.palette_size == -1) {
-        options.palette_size = DEFAULT_MAX_PALETTE_SIZE;
-        if (nb_pixels * images.size() / 3 < DEFAULT_MAX_PALETTE_SIZE) {
-          options.palette_size = nb_pixels * images.size() / 3;
-        }
-    }
-    if (!options.loss && options.palette_size != 0) {
-        desc.push_back("Palette_Alpha");  // try palette (including alpha)
-        desc.push_back("Palette");  // try palette (without alpha)
-    }
-    if (!options.loss) {
-    if (options.acb == -1) {
-      // not specified if ACB should be used
-      if (nb_pixels * images.size() > 10000) {
-        desc.push_back("Color_Buckets");  // try auto color buckets on large images
-      }
-    } else if (options.acb) {
-      desc.push_back("Color_Buckets");  // try auto color buckets if forced
-    }
-    }
-    if (options.method.o == Optional::undefined) {
-        // no method specified, pick one heuristically
-        if (nb_pixels * images.size() < 10000) options.method.encoding=flifEncoding::nonInterlaced; // if the image is small, not much point in doing interlacing
-        else options.method.encoding=flifEncoding::interlaced; // default method: interlacing
-    }
-    if (images.size() > 1) {
-        desc.push_back("Duplicate_Frame");  // find duplicate frames
-        if (!options.loss) { // only if lossless
-          if (options.frs) desc.push_back("Frame_Shape");  // get the shapes of the frames
-          if (options.lookback) desc.push_back("Frame_Lookback");  // make a "deep" alpha channel (negative values are transparent to some previous frame)
-        }
-    }
-    if (options.learn_repeats < 0) {
-        // no number of repeats specified, pick a number heuristically
-        options.learn_repeats = TREE_LEARN_REPEATS;
-        //if (nb_pixels * images.size() < 5000) learn_repeats--;        // avoid large trees for small images
-        if (options.learn_repeats < 0) options.learn_repeats=0;
-    }
+    std::vector<std::string> desc = choose_transforms(images, options);
     bool result = true;
     if (!options.just_add_loss) {
       FILE *file = NULL;
@@ -362,6 +310,33 @@ bool handle_encode(int argc, char **argv, Images &images, flif_options &options)
     return encode_flif(argc, argv, images, options);
 }
 
+// learn the trees of every input image in turn, each time starting from the trees learned so far
+int handle_make_dictionary(int argc, char **argv, flif_options &options, ForestDictionary &dictionary, const char *filename) {
+    if (options.just_add_loss || options.chroma_subsampling || options.tile_size) { e_printf("Error: options not supported when making a dictionary\n"); return 1; }
+    if (file_exists(filename) && !options.overwrite) {
+        e_printf("Error: output file already exists: %s\nUse --overwrite to force overwrite.\n",filename);
+        return 1;
+    }
+    dictionary.training = true;
+    options.dictionary = &dictionary;
+    // keep the splits learned on earlier images, even if the current image does not use them
+    options.min_size = INT_MIN;
+    for (int i = 0; i < argc; i++) {
+        Images images;
+        flif_options image_options = options;
+        if (!encode_load_input_images(2, argv+i, images, image_options)) return 2;
+        if (!image_options.alpha_zero_special) for (Image& image : images) image.alpha_zero_special = false;
+        std::vector<std::string> desc = choose_transforms(images, image_options);
+        BlobIO bio;
+        if (!flif_encode(bio, images, desc, image_options)) return 2;
+        images[0].clear();
+        v_printf(2,"Learned trees from %s (%i/%i)\n", argv[i], i+1, argc);
+    }
+    if (!dictionary.save(filename)) return 2;
+    v_printf(2,"Wrote dictionary to %s\n", filename);
+    return 0;
+}
+
 #endif
 
 bool decode_flif(char **argv, Images &images, flif_options &options) {
@@ -374,6 +349,11 @@ bool decode_flif(char **argv, Images &images, flif_options &options) {
     md.icc = options.color_profile;
     md.xmp = options.metadata;
     md.exif = options.metadata;
+    FileMapping map(file);
+    if (map.data()) {
+        BlobReader reader(map.data(), map.size(), fio.getName());
+        return flif_decode(reader, images, options, md);
+    }
     return flif_decode(fio, images, options, md);
 }
 
@@ -462,6 +442,37 @@ int handle_decode(int argc, char **argv, Images &images, flif_options &options)
     return 0;
 }
 
+// serve a truncated FLIF file: just copy the prefix that is needed for the requested scale/quality
+int handle_truncate(int argc, char **argv, flif_options &options) {
+    if (argc != 2) { e_printf("Error: expected an input and an output FLIF file\n"); return 1; }
+    if (options.resize_width || options.resize_height) { e_printf("Error: use -s or -q to select the truncation point\n"); return 1; }
+    FILE *file = strcmp(argv[0],"-") ? fopen(argv[0],"rb") : stdin;
+    if (!file) { e_printf("Could not open file: %s\n", argv[0]); return 1; }
+    FileMapping map(file);
+    const uint8_t *data = map.data();
+    size_t size = map.size();
+    std::vector<uint8_t> buffer;
+    if (!data) {
+        uint8_t block[4096];
+        size_t n;
+        while ((n = fread(block, 1, sizeof(block), file)) > 0) buffer.insert(buffer.end(), block, block+n);
+        data = buffer.data();
+        size = buffer.size();
+    }
+    size_t length;
+    int result = 0;
+    if (!flif_truncation_length(data, size, options.scale, options.quality, length)) {
+        result = 3;
+    } else {
+        FILE *out = strcmp(argv[1],"-") ? fopen(argv[1],"wb") : stdout;
+        if (!out || fwrite(data, 1, length, out) != length) { e_printf("Could not write file: %s\n", argv[1]); result = 2; }
+        else v_printf(2,"Wrote %lu of %lu bytes to %s\n", (unsigned long)length, (unsigned long)size, argv[1]);
+        if (out && out != stdout) fclose(out);
+    }
+    if (file != stdin) fclose(file);
+    return result;
+}
+
 int main(int argc, char **argv) {
     Images images;
     flif_options options = FLIF_DEFAULT_OPTIONS;
@@ -471,7 +482,9 @@ int main(int argc, char **argv) {
     _setmode(_fileno(stderr), _O_BINARY);
 #endif
 #ifdef HAS_ENCODER
-    int mode = -1; // 0 = encode, 1 = decode, 2 = transcode
+    int mode = -1; // 0 = encode, 1 = decode, 2 = transcode, 3 = truncate, 4 = make dictionary
+    const char *dictionary_file = NULL;
+    ForestDictionary dictionary;
 #else
     int mode = 1;
 #endif
@@ -491,11 +504,14 @@ int main(int argc, char **argv) {
         {"scale", 1, NULL, 's'},
         {"resize", 1, NULL, 'r'},
         {"fit", 1, NULL, 'f'},
+        {"crop", 1, NULL, 'g'},
         {"identify", 0, NULL, 'i'},
         {"version", 0, NULL, 'V'},
         {"overwrite", 0, NULL, 'o'},
         {"breakpoints", 0, NULL, 'b'},
         {"keep-palette", 0, NULL, 'k'},
+        {"threads", 1, NULL, 'j'},
+        {"truncate", 0, NULL, 'x'},
 #ifdef HAS_ENCODER
         {"encode", 0, NULL, 'e'},
         {"transcode", 0, NULL, 't'},
@@ -511,6 +527,7 @@ int main(int argc, char **argv) {
         {"max-frame-lookback", 1, NULL, 'L'},
         {"no-frame-shape", 0, NULL, 'S'},
         {"maniac-repeats", 1, NULL, 'R'},
+        {"maniac-sample", 1, NULL, 'a'},
         {"maniac-divisor", 1, NULL, 'D'},
         {"maniac-min-size", 1, NULL, 'M'},
         {"maniac-threshold", 1, NULL, 'T'},
@@ -523,14 +540,18 @@ int main(int argc, char **argv) {
         {"effort", 1, NULL, 'E'},
         {"chroma-subsample", 0, NULL, 'J'},
         {"no-subtract-green", 0, NULL, 'W'},
+        {"tile-size", 1, NULL, 'O'},
+        {"truncation-index", 0, NULL, 'z'},
+        {"dictionary", 1, NULL, 'l'},
+        {"make-dictionary", 1, NULL, 'u'},
 #endif
         {0, 0, 0, 0}
     };
     int i,c;
 #ifdef HAS_ENCODER
-    while ((c = getopt_long (argc, argv, "hdvcmiVq:s:r:f:obketINnF:KP:ABYWCL:SR:D:M:T:X:Z:Q:UG:H:E:J", optlist, &i)) != -1) {
+    while ((c = getopt_long (argc, argv, "hdvcmiVq:s:r:f:g:obkj:xetINnF:KP:ABYWCL:SR:D:M:T:X:Z:Q:UG:H:E:JO:zl:u:a:", optlist, &i)) != -1) {
 #else
-    while ((c = getopt_long (argc, argv, "hdvcmiVq:s:r:f:obk", optlist, &i)) != -1) {
+    while ((c = getopt_long (argc, argv, "hdvcmiVq:s:r:f:g:obkj:x", optlist, &i)) != -1) {
 #endif
         switch (c) {
         case 'd': mode=1; break;
@@ -556,9 +577,18 @@ int main(int argc, char **argv) {
                   }
                   options.fit=1;
                   break;
+        case 'g': if (sscanf(optarg,"%ix%i+%i+%i", &options.crop_width, &options.crop_height, &options.crop_x, &options.crop_y) < 4
+                      || options.crop_width <= 0 || options.crop_height <= 0 || options.crop_x < 0 || options.crop_y < 0) {
+                    e_printf("Not a sensible value for option -g (expected WxH+X+Y)\n"); return 1;
+                  }
+                  break;
         case 'i': options.scale = -1; break;
         case 'b': options.show_breakpoints = 8; mode=1; break;
         case 'k': options.keep_palette = true; break;
+        case 'x': mode=3; break;
+        case 'j': options.threads=atoi(optarg);
+                  if (options.threads < 0 || options.threads > 256) {e_printf("Not a sensible number for option -j\n"); return 1; }
+                  break;
 #ifdef HAS_ENCODER
         case 'e': mode=0; break;
         case 't': mode=2; break;
@@ -575,6 +605,15 @@ int main(int argc, char **argv) {
         case 'R': options.learn_repeats=atoi(optarg);
                   if (options.learn_repeats < 0 || options.learn_repeats > 20) {e_printf("Not a sensible number for option -R\n"); return 1; }
                   break;
+        case 'a': options.learn_sample=atoi(optarg);
+                  if (options.learn_sample < 0) {e_printf("Not a sensible number for option -a\n"); return 1; }
+                  break;
+        case 'O': options.tile_size=atoi(optarg);
+                  if (options.tile_size < 0 || options.tile_size % 64) {e_printf("Not a sensible number for option -O (expected a multiple of 64)\n"); return 1; }
+                  break;
+        case 'z': options.truncation_index=1; break;
+        case 'l': dictionary_file=optarg; break;
+        case 'u': dictionary_file=optarg; mode=4; break;
         case 'F': options.frame_delay.clear();
                   while(optarg != 0) {
                     int d=strtol(optarg,&optarg,10);
@@ -676,7 +715,7 @@ int main(int argc, char **argv) {
     }
     argc -= optind;
     argv += optind;
-    bool last_is_output = (options.scale != -1);
+    bool last_is_output = (options.scale != -1 && mode != 4);
     if (options.show_breakpoints && argc == 1) { last_is_output = false; options.no_full_decode = 1; options.scale = 2; }
 
     if (!strcmp(argv[argc-1],"-")) {
@@ -689,6 +728,13 @@ int main(int argc, char **argv) {
         if (get_verbosity() == 1 || showhelp) show_help(mode);
         return 0;
     }
+#ifdef HAS_ENCODER
+    if (mode == 4) return handle_make_dictionary(argc, argv, options, dictionary, dictionary_file);
+    if (dictionary_file) {
+        if (!dictionary.load(dictionary_file)) return 1;
+        options.dictionary = &dictionary;
+    }
+#endif
 
     if (argc == 1 && last_is_output) {
         show_help(mode);
@@ -737,7 +783,7 @@ int main(int argc, char **argv) {
     } else if (argc>0) {
         if (!strcmp(argv[0],"-")) {
           v_printf(4,"Taking input from standard input. Mode: %s\n",
-             (mode==0?"encode": (mode==1?"decode":"transcode")));
+             (mode==0?"encode": (mode==1?"decode": (mode==2?"transcode":"truncate"))));
         } else if (!strchr(argv[0],'%')) {
           e_printf("Error: input file does not exist: %s\n",argv[0]);
           return 1;
@@ -755,6 +801,7 @@ int main(int argc, char **argv) {
         e_printf("Transcode (-t) does not work with -k as it requires either to be PNG.\n");
         return 1;
     }
+    if (mode == 3) return handle_truncate(argc, argv, options);
 
 #ifdef HAS_ENCODER
     if (options.chroma_subsampling)
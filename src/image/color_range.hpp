@@ -17,6 +17,12 @@ public:
     virtual void minmax(const int p, const prevPlanes &, ColorVal &minv, ColorVal &maxv) const { minv=min(p); maxv=max(p); }
     virtual void snap(const int p, const prevPlanes &pp, ColorVal &minv, ColorVal &maxv, ColorVal &v) const {
         minmax(p,pp,minv,maxv);
+        clamp(minv,maxv,v);
+    }
+    virtual bool isStatic() const { return true; }
+    virtual const ColorRanges* previous() const { return NULL; }
+protected:
+    static void clamp(ColorVal &minv, ColorVal &maxv, ColorVal &v) {
         if (minv > maxv) { //e_printf("Corruption detected!\n");
             // this should only happen on malicious/corrupt input files, or while adding loss
            maxv=minv;
@@ -27,8 +33,6 @@ public:
         assert(v <= maxv);
         assert(v >= minv);
     }
-    virtual bool isStatic() const { return true; }
-    virtual const ColorRanges* previous() const { return NULL; }
 };
 
 typedef std::vector<std::pair<ColorVal, ColorVal> > StaticColorRangeList;
@@ -23,6 +23,7 @@ enum {
 
 #include "image.hpp"
 #include "image-png.hpp"
+#include "../transform/rowkernels.hpp"
 
 #ifdef HAS_ENCODER
 #include "image-png-metadata.hpp"
@@ -89,14 +90,12 @@ int image_load_png(const char *filename, Image &image, metadata_options &options
   png_init_io(png_ptr,fp);
   png_set_sig_bytes(png_ptr,8);
 
-
-  int png_flags = PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND;
-  if (image.palette) {
-    // allowed to make a palette image
-    png_flags = PNG_TRANSFORM_PACKING;
-  }
-  png_read_png(png_ptr,info_ptr, png_flags, NULL);
-//      | PNG_TRANSFORM_STRIP_ALPHA | PNG_TRANSFORM_STRIP_16
+  png_read_info(png_ptr,info_ptr);
+  // the same transformations as PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND in png_read_png()
+  png_set_packing(png_ptr);
+  if (!image.palette) png_set_expand(png_ptr);  // else allowed to make a palette image
+  const int passes = png_set_interlace_handling(png_ptr);
+  png_read_update_info(png_ptr,info_ptr);
 
   size_t width = png_get_image_width(png_ptr,info_ptr);
   size_t height = png_get_image_height(png_ptr,info_ptr);
@@ -117,6 +116,13 @@ int image_load_png(const char *filename, Image &image, metadata_options &options
         return 6;
     }
 #endif
+  if (bit_depth != 8 && bit_depth != 16) {
+      e_printf("Should not happen: unsupported PNG bit depth: %i!\n",bit_depth);
+      png_destroy_read_struct(&png_ptr,&info_ptr,(png_infopp) NULL);
+      fclose(fp);
+      return 7;
+  }
+
   if (color_type == PNG_COLOR_TYPE_PALETTE) {
       image.semi_init(width, height, 0, (1<<bit_depth)-1, nbplanes);
       image.make_constant_plane(0,0);
@@ -140,107 +146,41 @@ int image_load_png(const char *filename, Image &image, metadata_options &options
   } else
       image.init(width, height, 0, (1<<bit_depth)-1, nbplanes);
 
-  png_bytepp rows = png_get_rows(png_ptr,info_ptr);
-
-  if (bit_depth == 8) {
-    switch(color_type) {
+  // The rows are decoded one at a time and split straight into the planes, so libpng never holds a copy of the
+  // whole image. Only interlaced PNGs are read completely first, since their passes each cover all the rows.
+  const size_t rowbytes = png_get_rowbytes(png_ptr,info_ptr);
+  const int channels = png_get_channels(png_ptr,info_ptr);
+  std::vector<png_byte> buffer(passes > 1 ? rowbytes * height : rowbytes);
+  if (passes > 1) {
+      std::vector<png_bytep> rows(height);
+      for (size_t r = 0; r < height; r++) rows[r] = &buffer[r * rowbytes];
+      png_read_image(png_ptr, rows.data());
+  }
+  std::vector<ColorVal> split(channels * width);
+  ColorVal *row[4];
+  for (int ch = 0; ch < channels && ch < 4; ch++) row[ch] = &split[ch * width];
+  const RowKernels &kernels = row_kernels();
+  for (size_t r = 0; r < height; r++) {
+      png_bytep in = &buffer[passes > 1 ? r * rowbytes : 0];
+      if (passes == 1) png_read_row(png_ptr, in, NULL);
+      kernels.deinterleave(in, width, channels, bit_depth / 8, row);
+      switch(color_type) {
         case PNG_COLOR_TYPE_PALETTE:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(1,r,c, (uint8_t) row[c * 1 + 0]);
-            }
-          }
-          break;
-        case PNG_COLOR_TYPE_GRAY:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (uint8_t) row[c * 1 + 0]);
-            }
-          }
-          break;
-        case PNG_COLOR_TYPE_GRAY_ALPHA:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (uint8_t) row[c * 2 + 0]);
-              image.set(1,r,c, (uint8_t) row[c * 2 + 0]);
-              image.set(2,r,c, (uint8_t) row[c * 2 + 0]);
-              image.set(3,r,c, (uint8_t) row[c * 2 + 1]);
-            }
-          }
+          image.set_row(1, r, row[0]);
           break;
-        case PNG_COLOR_TYPE_RGB:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (uint8_t) row[c * 3 + 0]);
-              image.set(1,r,c, (uint8_t) row[c * 3 + 1]);
-              image.set(2,r,c, (uint8_t) row[c * 3 + 2]);
-            }
-          }
-          break;
-        case PNG_COLOR_TYPE_RGB_ALPHA:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (uint8_t) row[c * 4 + 0]);
-              image.set(1,r,c, (uint8_t) row[c * 4 + 1]);
-              image.set(2,r,c, (uint8_t) row[c * 4 + 2]);
-              image.set(3,r,c, (uint8_t) row[c * 4 + 3]);
-            }
-          }
-          break;
-        default:
-          e_printf("Should not happen: unsupported PNG color type!\n");
-    }
-  } else if (bit_depth == 16) {
-    switch(color_type) {
         case PNG_COLOR_TYPE_GRAY:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (((uint16_t) row[c * 2 + 0])<<8)+ (uint16_t) row[c * 2 + 1]);
-            }
-          }
+          image.set_row(0, r, row[0]);
           break;
         case PNG_COLOR_TYPE_GRAY_ALPHA:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (((uint16_t) row[c * 4 + 0])<<8)+ (uint16_t) row[c * 4 + 1]);
-              image.set(1,r,c, (((uint16_t) row[c * 4 + 0])<<8)+ (uint16_t) row[c * 4 + 1]);
-              image.set(2,r,c, (((uint16_t) row[c * 4 + 0])<<8)+ (uint16_t) row[c * 4 + 1]);
-              image.set(3,r,c, (((uint16_t) row[c * 4 + 2])<<8)+ (uint16_t) row[c * 4 + 3]);
-            }
-          }
+          for (int p = 0; p < 3; p++) image.set_row(p, r, row[0]);
+          image.set_row(3, r, row[1]);
           break;
-        case PNG_COLOR_TYPE_RGB:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (((uint16_t) row[c * 6 + 0])<<8)+ (uint16_t) row[c * 6 + 1]);
-              image.set(1,r,c, (((uint16_t) row[c * 6 + 2])<<8)+ (uint16_t) row[c * 6 + 3]);
-              image.set(2,r,c, (((uint16_t) row[c * 6 + 4])<<8)+ (uint16_t) row[c * 6 + 5]);
-            }
-          }
-          break;
-        case PNG_COLOR_TYPE_RGB_ALPHA:
-          for (size_t r = 0; r < height; r++) {
-            png_bytep row = rows[r];
-            for (size_t c = 0; c < width; c++) {
-              image.set(0,r,c, (((uint16_t) row[c * 8 + 0])<<8)+ (uint16_t) row[c * 8 + 1]);
-              image.set(1,r,c, (((uint16_t) row[c * 8 + 2])<<8)+ (uint16_t) row[c * 8 + 3]);
-              image.set(2,r,c, (((uint16_t) row[c * 8 + 4])<<8)+ (uint16_t) row[c * 8 + 5]);
-              image.set(3,r,c, (((uint16_t) row[c * 8 + 6])<<8)+ (uint16_t) row[c * 8 + 7]);
-            }
-          }
-          break;
-        default:
-          e_printf("Should not happen: unsupported PNG color type!\n");
-    }
-  } else e_printf("Should not happen: unsupported PNG bit depth: %i!\n",bit_depth);
+        default: // RGB, RGBA
+          for (int p = 0; p < channels; p++) image.set_row(p, r, row[p]);
+      }
+  }
+  // the text chunks with metadata can also come after the image data
+  png_read_end(png_ptr,info_ptr);
 
   // look for ICC color profile
   if (options.icc) {
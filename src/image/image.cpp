@@ -96,3 +96,28 @@ bool Image::save(const char *filename) const
     e_printf("ERROR: Unknown extension to write to: %s\n",ext ? ext : "(none)");
     return false;
 }
+
+template<typename pixel_t>
+static void write_interleaved_row(const ColorVal * const *planes, const int nump, pixel_t *row, const uint32_t width, ColorVal m, const ColorVal max_out)
+{
+    int rshift = 0;
+    int mult = 1;
+    while (m > max_out) { rshift++; m = m >> 1; } // image has a higher bit depth than the buffer
+    if ((m != 0) && m < max_out) mult = max_out / m;
+    for (uint32_t c = 0; c < width; c++) {
+        const ColorVal v = (planes[0][c] >> rshift) * mult;
+        row[4*c] = v;
+        row[4*c+1] = (nump >= 3 ? (planes[1][c] >> rshift) * mult : v);
+        row[4*c+2] = (nump >= 3 ? (planes[2][c] >> rshift) * mult : v);
+        row[4*c+3] = (nump >= 4 ? (planes[3][c] >> rshift) * mult : max_out);
+    }
+}
+
+void Image::write_RGBA_row(const ColorVal * const *row, const int nump, const uint32_t r, const PixelBuffer &out) const
+{
+    assert(!palette_image);
+    assert(out.width <= cols() && r < out.height);
+    uint8_t *dest = static_cast<uint8_t*>(out.pixels) + r * out.stride;
+    if (out.depth == 16) write_interleaved_row(row, nump, reinterpret_cast<uint16_t*>(dest), out.width, max(0), 0xFFFF);
+    else write_interleaved_row(row, nump, dest, out.width, max(0), 0xFF);
+}
@@ -24,6 +24,7 @@ limitations under the License.
 #include <string.h>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "crc32k.hpp"
 
 #include "../io.hpp"
@@ -159,6 +160,48 @@ std::unique_ptr<T> make_unique(Args &&... args)
     return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
 }
 
+// Buffers that are no longer needed, kept to be handed out again instead of allocating (and page faulting) new ones.
+// take(n) returns the smallest buffer with room for n elements; if none is big enough, the biggest one is returned
+// (it grows when it is filled) so buffers that are too small do not pile up. Thread-safe.
+template <typename T> class BufferPool {
+    std::mutex mutex;
+    std::vector<std::vector<T>> buffers;
+public:
+    std::vector<T> take(const size_t n) {
+        std::vector<T> result;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (buffers.empty()) return result;
+        size_t best = 0;
+        for (size_t i = 1; i < buffers.size(); i++) {
+            const size_t cap = buffers[i].capacity(), best_cap = buffers[best].capacity();
+            if (best_cap < n ? cap > best_cap : (cap >= n && cap < best_cap)) best = i;
+        }
+        result.swap(buffers[best]);
+        buffers[best].swap(buffers.back());
+        buffers.pop_back();
+        return result;
+    }
+    void give(std::vector<T> &&buffer) {
+        if (buffer.capacity() == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::move(buffer));
+    }
+};
+
+// the pixel buffers of planes, one pool per pixel type
+class PlaneBuffers {
+    BufferPool<ColorVal_intern_8> buffers_8;
+    BufferPool<ColorVal_intern_16> buffers_16;
+    BufferPool<ColorVal_intern_16u> buffers_16u;
+    BufferPool<ColorVal_intern_32> buffers_32;
+public:
+    template <typename pixel_t> BufferPool<pixel_t> &get();
+};
+template <> inline BufferPool<ColorVal_intern_8> &PlaneBuffers::get<ColorVal_intern_8>() { return buffers_8; }
+template <> inline BufferPool<ColorVal_intern_16> &PlaneBuffers::get<ColorVal_intern_16>() { return buffers_16; }
+template <> inline BufferPool<ColorVal_intern_16u> &PlaneBuffers::get<ColorVal_intern_16u>() { return buffers_16u; }
+template <> inline BufferPool<ColorVal_intern_32> &PlaneBuffers::get<ColorVal_intern_32>() { return buffers_32; }
+
 struct PlaneVisitor;
 
 //static const uint32_t pixelsizes[]={1,1,2,2,4,4,8,8,16,16,32,32,64,64,128,128,256,256,512,512,1024,1024,2048,2048,4096,4096,8192,8192,1<<14,1<<14,1<<15,1<<15,1<<16,1<<16};
@@ -177,13 +220,30 @@ public:
     virtual void prepare_zoomlevel(const int z) const =0;
     virtual ColorVal get_fast(size_t r, size_t c) const =0;
     virtual void set_fast(size_t r, size_t c, ColorVal x) =0;
+    // copy the first n pixels of a row from/to a buffer of ColorVals
+    virtual void get_row(const size_t r, const size_t n, ColorVal *out) const =0;
+    virtual void set_row(const size_t r, const size_t n, const ColorVal *in) =0;
+    // a copy of the plane, with its own buffer
+    virtual std::unique_ptr<GeneralPlane> clone() const =0;
+    // a copy of columns x0..x0+w-1 of rows y0..y0+h-1 (raster layout, scale 0)
+    virtual std::unique_ptr<GeneralPlane> crop(const size_t x0, const size_t y0, const size_t w, const size_t h) const =0;
+
+    // hand the pixel buffer to a pool for reuse; the plane must not be used anymore afterwards
+    virtual void release_buffer(FLIF_UNUSED(PlaneBuffers &buffers)) {}
 
     virtual bool is_constant() const { return false; }
     virtual int bytes_per_pixel() const { return 0; }
+    virtual size_t memory_size() const { return 0; }
     virtual ~GeneralPlane() { }
     virtual void set(const int z, const size_t r, const size_t c, const ColorVal x) =0;
     virtual ColorVal get(const int z, const size_t r, const size_t c) const =0;
     virtual void normalize_scale() {}
+    // Zoomlevel-major storage, used by the interlaced decoder on large images: the plane only keeps the pixels of
+    // zoomlevel z and coarser, as a dense grid of their own, so a pass over a coarse zoomlevel does not stride through
+    // the whole image. refine_zoomlevels(z) grows the grid to zoomlevel z when the decoder gets there; zoomlevel 0 is the
+    // normal raster layout, which is what all the other accessors (get/set(r,c), rows, crc) need.
+    virtual void store_zoomlevels_from(FLIF_UNUSED(const int z)) {}
+    virtual void refine_zoomlevels(FLIF_UNUSED(const int z)) {}
     virtual void accept_visitor(FLIF_UNUSED(PlaneVisitor &v)) =0;
     virtual uint32_t compute_crc32(uint32_t previous_crc32) =0;
     // access pixel by zoomlevel coordinate
@@ -226,9 +286,12 @@ template <typename pixel_t> class Plane final : public GeneralPlane {
     const size_t width, height;
     int s;
     mutable size_t s_r = 0, s_c = 0;
+    const pixel_t fill;
+    int zl = 0;          // zoomlevel of the stored grid (see store_zoomlevels_from)
+    size_t zl_width;     // its number of columns
 
-public:
-    Plane(size_t w, size_t h, ColorVal color=0, int scale = 0) : data_vec(PAD(SCALED(w)*SCALED(h)), color), width(SCALED(w)), height(SCALED(h)), s(scale) {
+    void allocate(const size_t size) {
+        data_vec.assign(PAD(size), fill);
       // Align only when required. The emscripten port doesn't work with padded alignment and doesn't support SIMD, so
       // `USE_SIMD` is a good condition for alignment, for now.
 #ifdef USE_SIMD
@@ -242,16 +305,68 @@ public:
         data = data_vec.data();
 #endif
         assert(data != nullptr);
+    }
+    static int zoom_rowshift(int z) { return (z+1)/2; }
+    static int zoom_colshift(int z) { return z/2; }
+    // switch the stored grid to zoomlevel z, keeping the pixels that are in both grids
+    void relayout(const int z) {
+        assert(s == 0);
+        const size_t new_width = ((width - 1) >> zoom_colshift(z)) + 1, new_height = ((height - 1) >> zoom_rowshift(z)) + 1;
+        std::vector<pixel_t> old_vec;
+        old_vec.swap(data_vec);
+        const pixel_t *old = data;
+        const size_t old_width = zl_width, old_height = ((height - 1) >> zoom_rowshift(zl)) + 1;
+        allocate(new_width * new_height);
+        if (z < zl) {
+            // finer grid: spread out the old pixels, the new ones are not decoded yet
+            const int rshift = zoom_rowshift(zl) - zoom_rowshift(z), cshift = zoom_colshift(zl) - zoom_colshift(z);
+            for (size_t r = 0; r < old_height; r++) {
+                pixel_t *row = data + (r << rshift) * new_width;
+                for (size_t c = 0; c < old_width; c++) row[c << cshift] = old[r * old_width + c];
+            }
+        } else {
+            const int rshift = zoom_rowshift(z) - zoom_rowshift(zl), cshift = zoom_colshift(z) - zoom_colshift(zl);
+            for (size_t r = 0; r < new_height; r++) {
+                const pixel_t *row = old + (r << rshift) * old_width;
+                for (size_t c = 0; c < new_width; c++) data[r * new_width + c] = row[c << cshift];
+            }
+        }
+        zl = z;
+        zl_width = new_width;
+    }
+
+public:
+    Plane(size_t w, size_t h, ColorVal color=0, int scale = 0, BufferPool<pixel_t> *pool = NULL) : width(SCALED(w)), height(SCALED(h)), s(scale), fill(color), zl_width(width) {
+        if (pool) data_vec = pool->take(PAD(width*height));
+        allocate(width*height);
         if (height > 1) v_printf(6,"Allocated %u x %u buffer (%i-bit).\n",width,height,8 * sizeof(pixel_t));
     }
+    Plane(const Plane& other) : width(other.width), height(other.height), s(other.s), fill(other.fill), zl(other.zl), zl_width(other.zl_width) {
+        const size_t size = height ? (((height - 1) >> zoom_rowshift(zl)) + 1) * zl_width : 0;
+        allocate(size);
+        if (size) memcpy(data, other.data, size * sizeof(pixel_t));
+    }
+    std::unique_ptr<GeneralPlane> clone() const override {
+        return make_unique<Plane<pixel_t>>(*this);
+    }
+    std::unique_ptr<GeneralPlane> crop(const size_t x0, const size_t y0, const size_t w, const size_t h) const override {
+        assert(zl==0); assert(s==0); assert(x0+w<=width); assert(y0+h<=height);
+        Plane<pixel_t> *cropped = new Plane<pixel_t>(w, h, fill);
+        for (size_t r = 0; r < h; r++) memcpy(cropped->data + r*w, data + (y0+r)*width + x0, w*sizeof(pixel_t));
+        return std::unique_ptr<GeneralPlane>(cropped);
+    }
     void clear() {
         data_vec.clear();
     }
+    void release_buffer(PlaneBuffers &buffers) override {
+        buffers.get<pixel_t>().give(std::move(data_vec));
+        data = nullptr;
+    }
     void set(const size_t r, const size_t c, const ColorVal x) override {
 //        const size_t sr = r>>s, sc = c>>s;
         const size_t sr = r, sc = c;
 //        assert(s==0);  // can also be used when using downscaled plane; in this case you have to make sure to use downscaled r,c !
-        assert(sr<height); assert(sc<width);
+        assert(sr<height); assert(sc<width); assert(zl==0);
         data[sr*width + sc] = x;
     }
     ColorVal get(const size_t r, const size_t c) const override ATTRIBUTE_HOT {
@@ -259,13 +374,14 @@ public:
 //        const size_t sr = r>>s, sc = c>>s;
         const size_t sr = r, sc = c;
 //        assert(s==0);  // can also be used when using downscaled plane; in this case you have to make sure to use downscaled r,c !
-        assert(sr<height); assert(sc<width);
+        assert(sr<height); assert(sc<width); assert(zl==0);
         return data[sr*width + sc];
     }
 // get/set specialized for a particular zoomlevel
     void prepare_zoomlevel(const int z) const override {
-        s_r = (zoom_rowpixelsize(z)>>s)*width;
-        s_c = (zoom_colpixelsize(z)>>s);
+        assert(z >= zl);
+        s_r = ((zoom_rowpixelsize(z)>>s)>>zoom_rowshift(zl))*zl_width;
+        s_c = ((zoom_colpixelsize(z)>>s)>>zoom_colshift(zl));
     }
     ColorVal get_fast(size_t r, size_t c) const override {
         return data[r*s_r+c*s_c];
@@ -273,6 +389,28 @@ public:
     void set_fast(size_t r, size_t c, ColorVal x) override {
         data[r*s_r+c*s_c] = x;
     }
+    void get_row(const size_t r, const size_t n, ColorVal *out) const override {
+        assert(r<height); assert(n<=width); assert(zl==0);
+        const pixel_t *row = data + r*width;
+        for (size_t c = 0; c < n; c++) out[c] = row[c];
+    }
+    void set_row(const size_t r, const size_t n, const ColorVal *in) override {
+        assert(r<height); assert(n<=width); assert(zl==0);
+        pixel_t *row = data + r*width;
+        for (size_t c = 0; c < n; c++) row[c] = in[c];
+    }
+    // read-only accessor with its own zoomlevel strides (unlike prepare_zoomlevel, this is safe to use from several threads)
+    class ZoomView {
+        const pixel_t* data;
+        const size_t s_r, s_c;
+    public:
+        ZoomView(const pixel_t* d, size_t sr, size_t sc) : data(d), s_r(sr), s_c(sc) {}
+        ColorVal get_fast(size_t r, size_t c) const { return data[r*s_r+c*s_c]; }
+    };
+    ZoomView zoom_view(const int z) const {
+        assert(z >= zl);
+        return ZoomView(data, ((zoom_rowpixelsize(z)>>s)>>zoom_rowshift(zl))*zl_width, (zoom_colpixelsize(z)>>s)>>zoom_colshift(zl));
+    }
 #ifdef USE_SIMD
 // methods to just get all the values quickly
     FourColorVals get4(const size_t pos) const ATTRIBUTE_HOT {
@@ -323,20 +461,30 @@ public:
 #endif
     void set(const int z, const size_t r, const size_t c, const ColorVal x) override {
 //        set(r*zoom_rowpixelsize(z),c*zoom_colpixelsize(z),x);
-         data[(r*zoom_rowpixelsize(z)>>s)*width + (c*zoom_colpixelsize(z)>>s)] = x;
+         assert(z >= zl || (r == 0 && c == 0));
+         data[((r*zoom_rowpixelsize(z)>>s)>>zoom_rowshift(zl))*zl_width + ((c*zoom_colpixelsize(z)>>s)>>zoom_colshift(zl))] = x;
     }
     ColorVal get(const int z, const size_t r, const size_t c) const override {
 //        return get(r*zoom_rowpixelsize(z),c*zoom_colpixelsize(z));
-        return data[(r*zoom_rowpixelsize(z)>>s)*width + (c*zoom_colpixelsize(z)>>s)];
+        assert(z >= zl || (r == 0 && c == 0));
+        return data[((r*zoom_rowpixelsize(z)>>s)>>zoom_rowshift(zl))*zl_width + ((c*zoom_colpixelsize(z)>>s)>>zoom_colshift(zl))];
     }
     void normalize_scale() override { s = 0; }
+    void store_zoomlevels_from(const int z) override {
+        if (z != zl) relayout(z);
+    }
+    void refine_zoomlevels(const int z) override {
+        if (z < zl) relayout(z);
+    }
 
     int bytes_per_pixel() const override { return sizeof(pixel_t); }
+    size_t memory_size() const override { return data_vec.capacity() * sizeof(pixel_t); }
 
     void accept_visitor(FLIF_UNUSED(PlaneVisitor &v)) override {
         v.visit(*this);
     }
     uint32_t compute_crc32(uint32_t previous_crc32) override {
+        assert(zl==0);
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
         // temporarily make the buffer little endian (TODO: avoid this by modifying the crc to take the swapped bytes into account directly)
         if (sizeof(pixel_t) == 2) {
@@ -362,6 +510,12 @@ class ConstantPlane final : public GeneralPlane {
     ColorVal color;
 public:
     explicit ConstantPlane(ColorVal c) : color(c) {}
+    std::unique_ptr<GeneralPlane> clone() const override {
+        return make_unique<ConstantPlane>(color);
+    }
+    std::unique_ptr<GeneralPlane> crop(FLIF_UNUSED(const size_t x0), FLIF_UNUSED(const size_t y0), FLIF_UNUSED(const size_t w), FLIF_UNUSED(const size_t h)) const override {
+        return clone();
+    }
     void set(FLIF_UNUSED(const size_t r), FLIF_UNUSED(const size_t c), FLIF_UNUSED(const ColorVal x)) override {
         assert(x == color);
     }
@@ -372,6 +526,19 @@ public:
     void prepare_zoomlevel(FLIF_UNUSED(const int z)) const override {}
     ColorVal get_fast(FLIF_UNUSED(size_t r), FLIF_UNUSED(size_t c)) const override { return color; }
     void set_fast(FLIF_UNUSED(size_t r), FLIF_UNUSED(size_t c), FLIF_UNUSED(ColorVal x)) override { assert(x == color); }
+    void get_row(FLIF_UNUSED(const size_t r), const size_t n, ColorVal *out) const override {
+        for (size_t c = 0; c < n; c++) out[c] = color;
+    }
+    void set_row(FLIF_UNUSED(const size_t r), FLIF_UNUSED(const size_t n), FLIF_UNUSED(const ColorVal *in)) override {
+        for (size_t c = 0; c < n; c++) assert(in[c] == color);
+    }
+    class ZoomView {
+        const ColorVal color;
+    public:
+        explicit ZoomView(ColorVal c) : color(c) {}
+        ColorVal get_fast(FLIF_UNUSED(size_t r), FLIF_UNUSED(size_t c)) const { return color; }
+    };
+    ZoomView zoom_view(FLIF_UNUSED(const int z)) const { return ZoomView(color); }
 
 #ifdef USE_SIMD
     FourColorVals get4(FLIF_UNUSED(const size_t pos)) const ATTRIBUTE_HOT {
@@ -438,6 +605,14 @@ struct MetaData {
     std::vector<unsigned char> contents;
 };
 
+// caller-owned interleaved RGBA buffer (8 or 16 bits per channel) that the decoder writes into directly
+struct PixelBuffer {
+    void *pixels;
+    uint32_t width, height;
+    size_t stride;              // bytes from the start of one row to the next
+    int depth;                  // 8 or 16
+};
+
 struct metadata_options {
     bool icc;
     bool exif;
@@ -445,7 +620,7 @@ struct metadata_options {
 };
 
 class Image {
-    std::unique_ptr<GeneralPlane> planes[5]; // Red/Y, Green/Co, Blue/Cg, Alpha, Frame-Lookback(animation only)
+    std::shared_ptr<GeneralPlane> planes[5]; // Red/Y, Green/Co, Blue/Cg, Alpha, Frame-Lookback(animation only)
     size_t width, height;
     ColorVal minval,maxval;
     int num;
@@ -462,6 +637,7 @@ class Image {
     }
 
 
+    // Copies share their planes with the original (see own_plane), so this is cheap.
     Image& operator=(const Image& other) {
       width = other.width;
       height = other.height;
@@ -483,32 +659,50 @@ class Image {
       col_end = other.col_end;
       seen_before = other.seen_before;
       fully_decoded = other.fully_decoded;
-      {
-      int p=num;
-      if (depth <= 8) {
-        if (p>0) planes[0] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // R,Y
-        if (p>1) planes[1] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // G,I
-        if (p>2) planes[2] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // B,Q
-        if (p>3) planes[3] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // A
-#ifdef SUPPORT_HDR
-      } else {
-        if (p>0) planes[0] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // R,Y
-        if (p>1) planes[1] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // G,I
-        if (p>2) planes[2] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // B,Q
-        if (p>3) planes[3] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // A
-#endif
-      }
-      if (p>4) planes[4] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // FRA
+      for (int p=0; p<num; p++) {
+        const GeneralPlane &src = *other.planes[p];
+        if (!src.is_constant() && src.bytes_per_pixel() == default_bytes_per_pixel(p)) {
+          planes[p] = other.planes[p];
+          continue;
+        }
+        // constant planes and 8-bit palette indices become a plane of the usual type, which can hold any value
+        planes[p] = new_plane(p);
+        std::vector<ColorVal> row(SCALED(width));
+        for (size_t r=0; r<SCALED(height); r++) {
+          src.get_row(r, row.size(), row.data());
+          planes[p]->set_row(r, row.size(), row.data());
+        }
       }
-      for(int p=0; p<num; p++)
-          for (size_t r=0; r<SCALED(height); r++)
-             for (size_t c=0; c<SCALED(width); c++)
-                 set(p,r,c,other.operator()(p,r,c));
-
       return *this;
     }
 
+    // a plane of the type that init() allocates for plane p
+    std::unique_ptr<GeneralPlane> new_plane(const int p) const {
+#ifdef SUPPORT_HDR
+      if (depth > 8) {
+        if (p==0 || p==3) return make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // R,Y / A
+        if (p==4) return make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // FRA
+        return make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // G,I / B,Q
+      }
+#endif
+      if (p==0 || p==3 || p==4) return make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // R,Y / A / FRA
+      return make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // G,I / B,Q
+    }
+    int default_bytes_per_pixel(const int p) const {
+      if (p == 4) return 1;
+      const int bytes = (p == 1 || p == 2 ? 2 : 1);
+      return depth <= 8 ? bytes : 2 * bytes;
+    }
+
+    template <typename pixel_t> std::unique_ptr<GeneralPlane> pooled_plane(PlaneBuffers *buffers) const {
+      return make_unique<Plane<pixel_t>>(width, height, 0, scale, buffers ? &buffers->get<pixel_t>() : NULL);
+    }
 
+    // A plane can be shared by an image and its clones; it is copied when one of them is about to write to it.
+    GeneralPlane& own_plane(const int p) {
+      if (planes[p].use_count() > 1) planes[p] = planes[p]->clone();
+      return *planes[p];
+    }
 
 public:
     bool palette;
@@ -650,28 +844,17 @@ public:
       seen_before = other.seen_before;
       fully_decoded = other.fully_decoded;
       clear();
-      {
-      int p=num;
-      if (depth <= 8) {
-        if (p>0) planes[0] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // R,Y
-        if (p>1) planes[1] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // G,I
-        if (p>2) planes[2] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // B,Q
-        if (p>3) planes[3] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // A
-#ifdef SUPPORT_HDR
-      } else {
-        if (p>0) planes[0] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // R,Y
-        if (p>1) planes[1] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // G,I
-        if (p>2) planes[2] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // B,Q
-        if (p>3) planes[3] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // A
-#endif
-      }
-      if (p>4) planes[4] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // FRA
-      }
       size_t scaledHeight = SCALED(height);
       size_t scaledWidth = SCALED(width);
       for(int p=0; p<num; p++) {
-        GeneralPlane& planeDest = getPlane(p);
         const GeneralPlane& planeSrc = other.getPlane(p);
+        // the pixels that are not decoded yet are still zero, so a plane of the usual type can be shared as it is
+        if (!planeSrc.is_constant() && planeSrc.bytes_per_pixel() == default_bytes_per_pixel(p)) {
+          planes[p] = other.planes[p];
+          continue;
+        }
+        planes[p] = new_plane(p);
+        GeneralPlane& planeDest = *planes[p];
         const size_t zoomlevelScaled = zoomlevels[p] + 1-(2*scale);
         const size_t strideRow = skipInterpolate[p] ? 1 :  1<<((zoomlevelScaled+1)/2);
         const size_t strideCol = skipInterpolate[p] ? 1 :  1<<((zoomlevelScaled)/2);
@@ -682,9 +865,9 @@ public:
           }
       }
     }
-    bool init(uint32_t w, uint32_t h, ColorVal min, ColorVal max, int p) {
+    bool init(uint32_t w, uint32_t h, ColorVal min, ColorVal max, int p, PlaneBuffers *buffers = NULL) {
       if (! semi_init(w,h,min,max,p) ) return false;
-      return real_init(false);
+      return real_init(false, buffers);
     }
     bool semi_init(uint32_t w, uint32_t h, ColorVal min, ColorVal max, int p) {
       width = w;
@@ -727,27 +910,28 @@ public:
       }
       return true;
     }
-    bool real_init(bool smaller_buffer) {
+    // allocates the planes, reusing the pixel buffers of a pool if there is one
+    bool real_init(bool smaller_buffer, PlaneBuffers *buffers = NULL) {
       int p = num;
 //      printf("smaller: %i\n",(int)smaller_buffer);
       try {
       if (depth <= 8) {
-        if (p>0 && !planes[0]) planes[0] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // R,Y
+        if (p>0 && !planes[0]) planes[0] = pooled_plane<ColorVal_intern_8>(buffers); // R,Y
         if (p>1 && !planes[1]) {
-          if (smaller_buffer)  planes[1] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale);  // 8-bit Palette
-          else                 planes[1] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // G,I
+          if (smaller_buffer)  planes[1] = pooled_plane<ColorVal_intern_8>(buffers);  // 8-bit Palette
+          else                 planes[1] = pooled_plane<ColorVal_intern_16>(buffers); // G,I
         }
-        if (p>2 && !planes[2]) planes[2] = make_unique<Plane<ColorVal_intern_16>>(width, height, 0, scale); // B,Q
-        if (p>3 && !planes[3]) planes[3] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // A
+        if (p>2 && !planes[2]) planes[2] = pooled_plane<ColorVal_intern_16>(buffers); // B,Q
+        if (p>3 && !planes[3]) planes[3] = pooled_plane<ColorVal_intern_8>(buffers); // A
 #ifdef SUPPORT_HDR
       } else {
-        if (p>0 && !planes[0]) planes[0] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // R,Y
-        if (p>1 && !planes[1]) planes[1] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // G,I
-        if (p>2 && !planes[2]) planes[2] = make_unique<Plane<ColorVal_intern_32>>(width, height, 0, scale); // B,Q
-        if (p>3 && !planes[3]) planes[3] = make_unique<Plane<ColorVal_intern_16u>>(width, height, 0, scale); // A
+        if (p>0 && !planes[0]) planes[0] = pooled_plane<ColorVal_intern_16u>(buffers); // R,Y
+        if (p>1 && !planes[1]) planes[1] = pooled_plane<ColorVal_intern_32>(buffers); // G,I
+        if (p>2 && !planes[2]) planes[2] = pooled_plane<ColorVal_intern_32>(buffers); // B,Q
+        if (p>3 && !planes[3]) planes[3] = pooled_plane<ColorVal_intern_16u>(buffers); // A
 #endif
       }
-      if (p>4 && !planes[4]) planes[4] = make_unique<Plane<ColorVal_intern_8>>(width, height, 0, scale); // FRA
+      if (p>4 && !planes[4]) planes[4] = pooled_plane<ColorVal_intern_8>(buffers); // FRA
       }
       catch (std::bad_alloc& ba) {
         e_printf("Error: could not allocate enough memory for image buffer.\n");
@@ -762,8 +946,14 @@ public:
     {
       return *this;
     }
+    // Gives the image its own copy of the planes it shares with clones. Writing to a shared plane makes that copy
+    // anyway, but not in a thread-safe way: call this before writing to the image from several threads.
+    void own_planes() {
+      for (int p = 0; p < num; p++) own_plane(p);
+    }
     void normalize_scale() {
 //      v_printf(3,"%ix%i -> ",width,height);
+      const bool scaled = scale != 0;
       width = SCALED(width);
       height = SCALED(height);
       scale = 0;
@@ -772,14 +962,20 @@ public:
       col_begin.resize(height,0);
       col_end.clear();
       col_end.resize(height,width);
-      for(int p = 0; p < num; p++)
-          planes[p]->normalize_scale();
+      if (scaled)
+        for(int p = 0; p < num; p++)
+          own_plane(p).normalize_scale();
     }
 
     void clear() {
-        for (int p=0; p<5; p++) planes[p].reset(nullptr);
+        for (int p=0; p<5; p++) planes[p].reset();
         palette_image.reset();
     }
+    // like clear(), but the pixel buffers go to a pool (planes that are still shared with a clone are left to it)
+    void recycle(PlaneBuffers &buffers) {
+        for (int p=0; p<5; p++) if (planes[p] && planes[p].use_count() == 1) planes[p]->release_buffer(buffers);
+        clear();
+    }
     void reset() {
         clear();
         init(0,0,0,0,0);
@@ -803,7 +999,7 @@ public:
     void drop_alpha() {
         if (num<4) return;
         assert(num==4);
-        planes[3].reset(nullptr);
+        planes[3].reset();
         num=3;
     }
     void make_invisible_rgb_black() {
@@ -822,18 +1018,18 @@ public:
     void drop_color() {
         if (num<2) return;
         assert(num==3);
-        planes[1].reset(nullptr);
-        planes[2].reset(nullptr);
+        planes[1].reset();
+        planes[2].reset();
         num=1;
     }
     void drop_frame_lookbacks() {
         assert(num==5);
-        planes[4].reset(nullptr);
+        planes[4].reset();
         num=4;
     }
     void make_constant_plane(const int p, const ColorVal val) {
       if (p>3 || p<0) return;
-      planes[p].reset(nullptr);
+      planes[p].reset();
       planes[p] = make_unique<ConstantPlane>(val);
     }
     void undo_make_constant_plane(const int p) {
@@ -843,13 +1039,13 @@ public:
         for (size_t r=0; r<SCALED(height); r++)
           for (size_t c=0; c<SCALED(width); c++)
             newp1->set(r,c,planes[p]->get(r,c));
-        planes[p].reset(nullptr);
+        planes[p].reset();
         planes[p] = std::move(newp1);
         return;
       }
       if (!planes[p]->is_constant()) return;
       ColorVal val = operator()(p,0,0);
-      planes[p].reset(nullptr);
+      planes[p].reset();
       if (depth <= 8) {
         if (p==0) planes[0] = make_unique<Plane<ColorVal_intern_8>>(width, height, val, scale); // R,Y
         if (p==1) planes[1] = make_unique<Plane<ColorVal_intern_16>>(width, height, val, scale); // G,I
@@ -900,6 +1096,9 @@ public:
     bool load(const char *name, metadata_options &options);
 #endif
     bool save(const char *name) const;
+    // converts row r, given as one buffer per plane, to interleaved RGBA in the output buffer,
+    // with the same scaling as the library's read_row functions
+    void write_RGBA_row(const ColorVal * const *row, const int nump, const uint32_t r, const PixelBuffer &out) const;
 
     // access pixel by coordinate
     ColorVal operator()(const int p, const size_t r, const size_t c) const ATTRIBUTE_HOT {
@@ -910,7 +1109,35 @@ public:
     void set(int p, size_t r, size_t c, ColorVal x) {
       assert(p>=0);
       assert(p<num);
-      planes[p]->set(r,c,x);
+      own_plane(p).set(r,c,x);
+    }
+
+    // keep only columns x0..x0+w-1 of rows y0..y0+h-1 (the image has to be at scale 1:1, see normalize_scale)
+    void crop(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h) {
+      assert(scale == 0);
+      assert(x0+w <= width); assert(y0+h <= height);
+      for (int p = 0; p < num; p++) planes[p] = planes[p]->crop(x0, y0, w, h);
+      width = w;
+      height = h;
+      col_begin.assign(height, 0);
+      col_end.assign(height, width);
+    }
+
+    // back to the normal raster layout after an interlaced decode in zoomlevel-major order (see GeneralPlane)
+    void restore_raster_layout() {
+      for (int p = 0; p < num; p++) own_plane(p).refine_zoomlevels(0);
+    }
+
+    // access a whole row of a plane (at scale 0)
+    void get_row(int p, size_t r, ColorVal *out) const {
+      assert(p>=0);
+      assert(p<num);
+      planes[p]->get_row(r,width,out);
+    }
+    void set_row(int p, size_t r, const ColorVal *in) {
+      assert(p>=0);
+      assert(p<num);
+      own_plane(p).set_row(r,width,in);
     }
 
     int numPlanes() const { return num; }
@@ -951,13 +1178,20 @@ public:
     void set(int p, int z, size_t rz, size_t cz, ColorVal x) {
         assert(p>=0);
         assert(p<num);
-        planes[p]->set(z,rz,cz,x);
+        own_plane(p).set(z,rz,cz,x);
+    }
+
+    // bytes allocated for the pixel data of all planes
+    size_t plane_memory() const {
+        size_t total = 0;
+        for (int p = 0; p < num; p++) if (planes[p]) total += planes[p]->memory_size();
+        return total;
     }
 
     GeneralPlane& getPlane(int p) {
         assert(p>=0);
         assert(p<num);
-        return *planes[p];
+        return own_plane(p);
     }
     const GeneralPlane& getPlane(int p) const{
         assert(p>=0);
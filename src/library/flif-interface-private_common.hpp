@@ -22,6 +22,7 @@ limitations under the License.
 
 #include "../image/image.hpp"
 #include "../fileio.hpp"
+#include "../common.hpp"
 
 #ifdef _WIN32
  #ifdef FLIF_BUILD_DLL
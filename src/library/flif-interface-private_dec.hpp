@@ -19,6 +19,8 @@ limitations under the License.
 #pragma once
 
 #include <stdio.h>
+#include <memory>
+#include <thread>
 
 #include "flif-interface-private_common.hpp"
 #include "../flif-dec.hpp"
@@ -30,6 +32,8 @@ struct FLIF_DECODER
     int32_t decode_file(const char* filename);
     int32_t decode_filepointer(FILE *file, const char* filename);
     int32_t decode_memory(const void* buffer, size_t buffer_size_bytes);
+    int32_t feed(const void* buffer, size_t buffer_size_bytes);
+    int32_t feed_end();
     int32_t abort();
     size_t num_images();
     int32_t num_loops();
@@ -39,15 +43,29 @@ struct FLIF_DECODER
     void* callback;
     void* user_data;
     int32_t first_quality;
+    PixelBuffer output;
+    std::unique_ptr<FLIF_STATS> stats; // NULL unless enabled with flif_decoder_set_stats
     ~FLIF_DECODER() {
+        if (stream) {
+            stream->close();
+            stream_thread.join();
+        }
         // get rid of palettes
         if (internal_images.size()) internal_images[0].clear();
         if (images.size()) images[0].clear();
     }
 
 private:
+    // releases the images of the previous decode, keeping their buffers for the next one
+    void recycle_images();
+
+    DecoderArena arena; // buffers reused from one decode to the next
     Images internal_images;
     Images images;
     std::vector<std::unique_ptr<FLIF_IMAGE>> requested_images;
     bool working;
+    // incremental decoding: flif_decode runs on its own thread and blocks on the stream when it needs more data
+    std::unique_ptr<StreamReader> stream;
+    std::thread stream_thread;
+    bool stream_result;
 };
@@ -21,6 +21,8 @@
 #include "flif-interface-private_common.hpp"
 #include "../flif-enc.hpp"
 
+typedef int32_t (*write_callback_t)(const void* data, size_t size, void* user_data); // as in flif_enc.h
+
 struct FLIF_ENCODER
 {
     FLIF_ENCODER();
@@ -30,8 +32,11 @@ struct FLIF_ENCODER
     void set_alpha_zero_flags();
     int32_t encode_file(const char* filename);
     int32_t encode_memory(void** buffer, size_t* buffer_size_bytes);
+    int32_t encode_callback(write_callback_t write_callback, void* user_data);
 
     flif_options options;
+    std::unique_ptr<FLIF_STATS> stats; // NULL unless enabled with flif_encoder_set_stats
+    std::unique_ptr<ForestDictionary> dictionary; // NULL unless set with flif_encoder_set_dictionary
 
     ~FLIF_ENCODER() {
         // get rid of palette
@@ -703,4 +703,57 @@ FLIF_DLLEXPORT void FLIF_API flif_free_memory(void* buffer) {
     delete [] reinterpret_cast<uint8_t*>(buffer);
 }
 
+FLIF_DLLEXPORT int32_t FLIF_API flif_stats_num_planes(FLIF_STATS* stats) {
+    return stats->num_planes();
+}
+
+FLIF_DLLEXPORT int32_t FLIF_API flif_stats_num_zoomlevels(FLIF_STATS* stats) {
+    return stats->num_zoomlevels();
+}
+
+FLIF_DLLEXPORT int64_t FLIF_API flif_stats_get_bytes(FLIF_STATS* stats, int32_t plane, int32_t zoomlevel) {
+    if (plane < 0 || plane >= stats->num_planes() || zoomlevel < 0 || zoomlevel >= (int32_t)stats->bytes[plane].size()) return 0;
+    return stats->bytes[plane][zoomlevel];
+}
+
+FLIF_DLLEXPORT int64_t FLIF_API flif_stats_get_symbols(FLIF_STATS* stats, int32_t plane, int32_t zoomlevel) {
+    if (plane < 0 || plane >= stats->num_planes() || zoomlevel < 0 || zoomlevel >= (int32_t)stats->symbols[plane].size()) return 0;
+    return stats->symbols[plane][zoomlevel];
+}
+
+FLIF_DLLEXPORT int64_t FLIF_API flif_stats_get_tree_nodes(FLIF_STATS* stats, int32_t plane) {
+    if (plane < 0 || plane >= (int32_t)stats->tree_nodes.size()) return 0;
+    return stats->tree_nodes[plane];
+}
+
+FLIF_DLLEXPORT int64_t FLIF_API flif_stats_get_tree_leaves(FLIF_STATS* stats, int32_t plane) {
+    if (plane < 0 || plane >= (int32_t)stats->tree_leaves.size()) return 0;
+    return stats->tree_leaves[plane];
+}
+
+FLIF_DLLEXPORT double FLIF_API flif_stats_get_average_tree_depth(FLIF_STATS* stats, int32_t plane) {
+    if (plane < 0 || plane >= stats->num_planes()) return 0;
+    int64_t symbols = 0;
+    for (int64_t s : stats->symbols[plane]) symbols += s;
+    return symbols ? (double)stats->tree_depth[plane] / symbols : 0;
+}
+
+FLIF_DLLEXPORT int32_t FLIF_API flif_stats_num_phases(void) {
+    return NB_PHASES;
+}
+
+FLIF_DLLEXPORT const char* FLIF_API flif_stats_get_phase_name(int32_t phase) {
+    if (phase < 0 || phase >= NB_PHASES) return NULL;
+    return phase_names[phase];
+}
+
+FLIF_DLLEXPORT double FLIF_API flif_stats_get_phase_seconds(FLIF_STATS* stats, int32_t phase) {
+    if (phase < 0 || phase >= NB_PHASES) return 0;
+    return stats->phase_seconds[phase];
+}
+
+FLIF_DLLEXPORT int64_t FLIF_API flif_stats_get_peak_plane_memory(FLIF_STATS* stats) {
+    return stats->peak_plane_memory;
+}
+
 } // extern "C"
@@ -28,8 +28,17 @@ FLIF_DECODER::FLIF_DECODER()
 , callback(NULL)
 , user_data(NULL)
 , first_quality(0)
+, output{NULL, 0, 0, 0, 8}
 , working(false)
-{ options.crc_check = 0; options.keep_palette = 1; }
+, stream_result(false)
+{ options.crc_check = 0; options.keep_palette = 1; options.arena = &arena; }
+
+void FLIF_DECODER::recycle_images() {
+    for (Image& image : internal_images) image.recycle(arena.planes);
+    for (Image& image : images) image.recycle(arena.planes);
+    internal_images.clear();
+    images.clear();
+}
 
 
 int32_t FLIF_DECODER::decode_file(const char* filename) {
@@ -41,10 +50,11 @@ int32_t FLIF_DECODER::decode_file(const char* filename) {
 }
 
 int32_t FLIF_DECODER::decode_filepointer(FILE *file, const char *filename) {
-    internal_images.clear();
-    images.clear();
+    recycle_images();
+    if (stats) *stats = FLIF_STATS();
 
     FileIO fio(file, filename);
+    FileMapping map(file);
 
     working = true;
     metadata_options md_default = {
@@ -52,7 +62,14 @@ int32_t FLIF_DECODER::decode_filepointer(FILE *file, const char *filename) {
          true, // exif
          true, // xmp
     };
-    if(!flif_decode(fio, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0))
+    bool ok;
+    if (map.data()) {
+        BlobReader reader(map.data(), map.size(), filename);
+        ok = flif_decode(reader, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0, output.pixels ? &output : NULL);
+    } else {
+        ok = flif_decode(fio, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0, output.pixels ? &output : NULL);
+    }
+    if(!ok)
         { working = false; return 0; }
     working = false;
 
@@ -63,8 +80,8 @@ int32_t FLIF_DECODER::decode_filepointer(FILE *file, const char *filename) {
 }
 
 int32_t FLIF_DECODER::decode_memory(const void* buffer, size_t buffer_size_bytes) {
-    internal_images.clear();
-    images.clear();
+    recycle_images();
+    if (stats) *stats = FLIF_STATS();
 
     BlobReader reader(reinterpret_cast<const uint8_t*>(buffer), buffer_size_bytes);
 
@@ -74,7 +91,7 @@ int32_t FLIF_DECODER::decode_memory(const void* buffer, size_t buffer_size_bytes
 		true, // exif
 		true, // xmp
     };
-    if(!flif_decode(reader, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0))
+    if(!flif_decode(reader, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0, output.pixels ? &output : NULL))
         { working = false; return 0; }
     working = false;
 
@@ -83,9 +100,47 @@ int32_t FLIF_DECODER::decode_memory(const void* buffer, size_t buffer_size_bytes
     return 1;
 }
 
+int32_t FLIF_DECODER::feed(const void* buffer, size_t buffer_size_bytes) {
+    if (!stream) {
+        recycle_images();
+        if (stats) *stats = FLIF_STATS();
+        stream.reset(new StreamReader());
+        stream_result = false;
+        working = true;
+        stream_thread = std::thread([this]() {
+            metadata_options md_default = {
+                true, // icc
+                true, // exif
+                true, // xmp
+            };
+            stream_result = flif_decode(*stream, internal_images, reinterpret_cast<callback_t>(callback), user_data, first_quality, images, options, md_default, 0, output.pixels ? &output : NULL);
+            stream->finish();
+        });
+    }
+    stream->push(reinterpret_cast<const uint8_t*>(buffer), buffer_size_bytes);
+    // let the decoder get as far as it can with what it has (progressive callbacks are issued meanwhile)
+    stream->wait_idle();
+    if (stream->has_finished() && !stream_result) return 0;
+    return 1;
+}
+
+int32_t FLIF_DECODER::feed_end() {
+    if (!stream) return 0;
+    stream->close();
+    stream_thread.join();
+    stream.reset();
+    working = false;
+    if (!stream_result) return 0;
+
+    images.clear();
+    for (Image& image : internal_images) images.emplace_back(std::move(image));
+    return 1;
+}
+
 int32_t FLIF_DECODER::abort() {
       if (working) {
         if (images.size() > 0) images[0].abort_decoding();
+        if (stream) stream->close();
         return 1;
       } else return 0;
 }
@@ -104,6 +159,7 @@ FLIF_IMAGE* FLIF_DECODER::get_image(size_t index) {
     if(index >= requested_images.size()) requested_images.resize(images.size());
     if (!requested_images[index].get()) requested_images[index].reset( new FLIF_IMAGE());
     if (images[index].rows() || images[index].metadata.size() > 0) {
+        requested_images[index]->image.recycle(arena.planes); // the image this replaces
         requested_images[index]->image = std::move(images[index]); // moves and invalidates images[index]
     }
     return requested_images[index].get();
@@ -113,16 +169,6 @@ FLIF_IMAGE* FLIF_DECODER::get_image(size_t index) {
 //=============================================================================
 
 
-FLIF_INFO::FLIF_INFO()
-: width(0)
-, height(0)
-, channels(0)
-, bit_depth(0)
-, num_images(0)
-{ }
-
-
-//=============================================================================
 
 /*!
 Notes about the C interface:
@@ -184,6 +230,25 @@ FLIF_DLLEXPORT void FLIF_API flif_decoder_set_fit(FLIF_DECODER* decoder, uint32_
     decoder->options.fit = 1;
 }
 
+FLIF_DLLEXPORT void FLIF_API flif_decoder_set_crop(FLIF_DECODER* decoder, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    decoder->options.crop_x = x;
+    decoder->options.crop_y = y;
+    decoder->options.crop_width = width;
+    decoder->options.crop_height = height;
+}
+
+FLIF_DLLEXPORT void FLIF_API flif_decoder_set_threads(FLIF_DECODER* decoder, int32_t threads) {
+    decoder->options.threads = threads;
+}
+
+FLIF_DLLEXPORT void FLIF_API flif_decoder_set_output_RGBA8(FLIF_DECODER* decoder, void* pixels, uint32_t width, uint32_t height, size_t stride) {
+    decoder->output = {pixels, width, height, stride, 8};
+}
+
+FLIF_DLLEXPORT void FLIF_API flif_decoder_set_output_RGBA16(FLIF_DECODER* decoder, void* pixels, uint32_t width, uint32_t height, size_t stride) {
+    decoder->output = {pixels, width, height, stride, 16};
+}
+
 FLIF_DLLEXPORT void FLIF_API flif_decoder_set_callback(FLIF_DECODER* decoder, callback_t callback, void *user_data) {
     try
     {
@@ -201,6 +266,19 @@ FLIF_DLLEXPORT void FLIF_API flif_decoder_set_first_callback_quality(FLIF_DECODE
     catch(...) {}
 }
 
+FLIF_DLLEXPORT void FLIF_API flif_decoder_set_stats(FLIF_DECODER* decoder, int32_t stats) {
+    try
+    {
+        decoder->stats.reset(stats ? new FLIF_STATS() : NULL);
+        decoder->options.stats = decoder->stats.get();
+    }
+    catch(...) {}
+}
+
+FLIF_DLLEXPORT FLIF_STATS* FLIF_API flif_decoder_get_stats(FLIF_DECODER* decoder) {
+    return decoder->stats.get();
+}
+
 
 /*!
 * \return non-zero if the function succeeded
@@ -240,6 +318,30 @@ FLIF_DLLEXPORT int32_t FLIF_API flif_decoder_decode_memory(FLIF_DECODER* decoder
     return 0;
 }
 
+/*!
+* \return zero if decoding failed
+*/
+FLIF_DLLEXPORT int32_t FLIF_API flif_decoder_feed(FLIF_DECODER* decoder, const void* buffer, size_t buffer_size_bytes) {
+    try
+    {
+        return decoder->feed(buffer, buffer_size_bytes);
+    }
+    catch(...) {}
+    return 0;
+}
+
+/*!
+* \return non-zero if the function succeeded
+*/
+FLIF_DLLEXPORT int32_t FLIF_API flif_decoder_feed_end(FLIF_DECODER* decoder) {
+    try
+    {
+        return decoder->feed_end();
+    }
+    catch(...) {}
+    return 0;
+}
+
 FLIF_DLLEXPORT size_t FLIF_API flif_decoder_num_images(FLIF_DECODER* decoder) {
     try
     {
@@ -305,6 +407,17 @@ FLIF_DLLEXPORT FLIF_INFO* FLIF_API flif_read_info_from_memory(const void* buffer
     return 0;
 }
 
+FLIF_DLLEXPORT size_t FLIF_API flif_truncate_memory(const void* buffer, size_t buffer_size_bytes, uint32_t scale, int32_t quality) {
+    try
+    {
+        size_t length;
+        if (flif_truncation_length(reinterpret_cast<const uint8_t*>(buffer), buffer_size_bytes, scale, quality, length))
+            return length;
+    }
+    catch(...) {}
+    return 0;
+}
+
 FLIF_DLLEXPORT void FLIF_API flif_destroy_info(FLIF_INFO* info) {
     try
     {
@@ -88,6 +88,7 @@ int32_t FLIF_ENCODER::encode_file(const char* filename) {
 
     std::vector<std::string> desc;
     transformations(desc);
+    if (stats) *stats = FLIF_STATS();
 
     if(!flif_encode(fio, images, desc, options))
         return 0;
@@ -103,6 +104,7 @@ int32_t FLIF_ENCODER::encode_memory(void** buffer, size_t* buffer_size_bytes) {
 
     std::vector<std::string> desc;
     transformations(desc);
+    if (stats) *stats = FLIF_STATS();
 
     if(!flif_encode(io, images, desc, options))
         return 0;
@@ -111,6 +113,23 @@ int32_t FLIF_ENCODER::encode_memory(void** buffer, size_t* buffer_size_bytes) {
     return 1;
 }
 
+/*!
+* \return non-zero if the function succeeded
+*/
+int32_t FLIF_ENCODER::encode_callback(write_callback_t write_callback, void* user_data) {
+    SinkIO io([=](const uint8_t* data, size_t size) { return write_callback(data, size, user_data) != 0; });
+
+    std::vector<std::string> desc;
+    transformations(desc);
+    if (stats) *stats = FLIF_STATS();
+
+    if(!flif_encode(io, images, desc, options))
+        return 0;
+
+    io.flush();
+    return io.ok();
+}
+
 //=============================================================================
 
 /*!
@@ -152,6 +171,10 @@ FLIF_DLLEXPORT void FLIF_API flif_encoder_set_learn_repeat(FLIF_ENCODER* encoder
     if (learn_repeats < 100) encoder->options.learn_repeats = learn_repeats;
 }
 
+FLIF_DLLEXPORT void FLIF_API flif_encoder_set_learn_sample(FLIF_ENCODER* encoder, uint32_t megapixels) {
+    if (megapixels < 0x10000) encoder->options.learn_sample = megapixels;
+}
+
 FLIF_DLLEXPORT void FLIF_API flif_encoder_set_auto_color_buckets(FLIF_ENCODER* encoder, uint32_t acb) {
     encoder->options.acb = acb;
 }
@@ -201,12 +224,45 @@ FLIF_DLLEXPORT void FLIF_API flif_encoder_set_ycocg(FLIF_ENCODER* encoder, int32
 FLIF_DLLEXPORT void FLIF_API flif_encoder_set_frame_shape(FLIF_ENCODER* encoder, int32_t frs) {
     encoder->options.frs = frs;
 }
+FLIF_DLLEXPORT void FLIF_API flif_encoder_set_threads(FLIF_ENCODER* encoder, int32_t threads) {
+    encoder->options.threads = threads;
+}
+FLIF_DLLEXPORT void FLIF_API flif_encoder_set_tile_size(FLIF_ENCODER* encoder, int32_t tile_size) {
+    encoder->options.tile_size = tile_size;
+}
+FLIF_DLLEXPORT void FLIF_API flif_encoder_set_truncation_index(FLIF_ENCODER* encoder, int32_t truncation_index) {
+    encoder->options.truncation_index = truncation_index;
+}
 FLIF_DLLEXPORT void FLIF_API flif_encoder_set_chance_cutoff(FLIF_ENCODER* encoder, int32_t cutoff) {
     encoder->options.cutoff = cutoff;
 }
 FLIF_DLLEXPORT void FLIF_API flif_encoder_set_chance_alpha(FLIF_ENCODER* encoder, int32_t alpha) {
     encoder->options.alpha = alpha;
 }
+FLIF_DLLEXPORT void FLIF_API flif_encoder_set_stats(FLIF_ENCODER* encoder, int32_t stats) {
+    try
+    {
+        encoder->stats.reset(stats ? new FLIF_STATS() : NULL);
+        encoder->options.stats = encoder->stats.get();
+    }
+    catch(...) {}
+}
+FLIF_DLLEXPORT FLIF_STATS* FLIF_API flif_encoder_get_stats(FLIF_ENCODER* encoder) {
+    return encoder->stats.get();
+}
+
+FLIF_DLLEXPORT int32_t FLIF_API flif_encoder_set_dictionary(FLIF_ENCODER* encoder, const char* filename) {
+    try
+    {
+        std::unique_ptr<ForestDictionary> dictionary(new ForestDictionary());
+        if (!dictionary->load(filename)) return 0;
+        encoder->dictionary = std::move(dictionary);
+        encoder->options.dictionary = encoder->dictionary.get();
+        return 1;
+    }
+    catch(...) {}
+    return 0;
+}
 
 FLIF_DLLEXPORT void FLIF_API flif_encoder_add_image(FLIF_ENCODER* encoder, FLIF_IMAGE* image) {
     try { encoder->add_image(image); }
@@ -241,6 +297,18 @@ FLIF_DLLEXPORT int32_t FLIF_API flif_encoder_encode_memory(FLIF_ENCODER* encoder
     return 0;
 }
 
+/*!
+* \return non-zero if the function succeeded
+*/
+FLIF_DLLEXPORT int32_t FLIF_API flif_encoder_encode_callback(FLIF_ENCODER* encoder, write_callback_t write_callback, void* user_data) {
+    try
+    {
+        return encoder->encode_callback(write_callback, user_data);
+    }
+    catch(...) {}
+    return 0;
+}
+
 
 } // extern "C"
 
@@ -88,6 +88,23 @@ extern "C" {
 
     FLIF_DLLIMPORT void FLIF_API flif_free_memory(void* buffer);
 
+    // Statistics of the last encode or decode (see flif_decoder_get_stats and flif_encoder_get_stats).
+    // Planes are the internal, transformed planes (e.g. Y, Co, Cg, A); zoomlevel 0 is full resolution.
+    // Non-interlaced images count everything at zoomlevel 0.
+    typedef struct FLIF_STATS FLIF_STATS;
+
+    FLIF_DLLIMPORT int32_t FLIF_API flif_stats_num_planes(FLIF_STATS* stats);
+    FLIF_DLLIMPORT int32_t FLIF_API flif_stats_num_zoomlevels(FLIF_STATS* stats);
+    FLIF_DLLIMPORT int64_t FLIF_API flif_stats_get_bytes(FLIF_STATS* stats, int32_t plane, int32_t zoomlevel);    // compressed pixel data
+    FLIF_DLLIMPORT int64_t FLIF_API flif_stats_get_symbols(FLIF_STATS* stats, int32_t plane, int32_t zoomlevel);  // MANIAC-coded pixel values
+    FLIF_DLLIMPORT int64_t FLIF_API flif_stats_get_tree_nodes(FLIF_STATS* stats, int32_t plane);   // MANIAC tree size, leaves included
+    FLIF_DLLIMPORT int64_t FLIF_API flif_stats_get_tree_leaves(FLIF_STATS* stats, int32_t plane);
+    FLIF_DLLIMPORT double  FLIF_API flif_stats_get_average_tree_depth(FLIF_STATS* stats, int32_t plane); // inner nodes visited per symbol
+    FLIF_DLLIMPORT int32_t FLIF_API flif_stats_num_phases(void);
+    FLIF_DLLIMPORT const char* FLIF_API flif_stats_get_phase_name(int32_t phase);  // "transform_process", "final_pass", ...
+    FLIF_DLLIMPORT double  FLIF_API flif_stats_get_phase_seconds(FLIF_STATS* stats, int32_t phase);
+    FLIF_DLLIMPORT int64_t FLIF_API flif_stats_get_peak_plane_memory(FLIF_STATS* stats);  // bytes of pixel planes allocated at the same time
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -47,6 +47,16 @@ extern "C" {
     */
     FLIF_DLLIMPORT int32_t FLIF_API flif_decoder_decode_filepointer(FLIF_DECODER* decoder, FILE *filepointer, const char *filename);
 
+    /*
+    * Incremental decoding: pass the FLIF data in chunks of any size as it arrives.
+    * Every call decodes as far as the data received so far allows; progressive callbacks (see below) are issued
+    * from within this call. Returns zero if decoding failed.
+    * flif_decoder_feed_end signals the end of the data and finishes decoding (a truncated file gives a partial image),
+    * after which the images can be retrieved as usual.
+    */
+    FLIF_DLLIMPORT int32_t FLIF_API flif_decoder_feed(FLIF_DECODER* decoder, const void* buffer, size_t buffer_size_bytes);
+    FLIF_DLLIMPORT int32_t FLIF_API flif_decoder_feed_end(FLIF_DECODER* decoder);
+
     // returns the number of frames (1 if it is not an animation)
     FLIF_DLLIMPORT size_t FLIF_API flif_decoder_num_images(FLIF_DECODER* decoder);
     // only relevant for animations: returns the loop count (0 = loop forever)
@@ -67,6 +77,19 @@ extern "C" {
     FLIF_DLLIMPORT void FLIF_API flif_decoder_set_scale(FLIF_DECODER* decoder, uint32_t scale); // valid scales: 1,2,4,8,16,...
     FLIF_DLLIMPORT void FLIF_API flif_decoder_set_resize(FLIF_DECODER* decoder, uint32_t width, uint32_t height);
     FLIF_DLLIMPORT void FLIF_API flif_decoder_set_fit(FLIF_DECODER* decoder, uint32_t width, uint32_t height);
+    // Only keep the region of width x height pixels at offset (x,y) of a still image; a width of 0 keeps everything.
+    // The region is given at full resolution; when decoding at a lower scale, the decoded image is the part that covers it.
+    // The whole image is still decoded, but only the region is interpolated (at lower quality or scale) and converted
+    // back to RGB(A). In tiled files, the tiles outside the region are skipped entirely.
+    FLIF_DLLIMPORT void FLIF_API flif_decoder_set_crop(FLIF_DECODER* decoder, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    FLIF_DLLIMPORT void FLIF_API flif_decoder_set_threads(FLIF_DECODER* decoder, int32_t threads); // tiled files; default: 0 = number of cores
+
+    // Decode straight into a caller-owned interleaved RGBA buffer instead of an internal FLIF_IMAGE.
+    // `stride` is the number of bytes between rows; width and height must match the decoded (possibly downscaled) image.
+    // Only still images are supported. The decoded images then carry metadata only, no pixels.
+    // Pass NULL as `pixels` to go back to decoding into a FLIF_IMAGE.
+    FLIF_DLLIMPORT void FLIF_API flif_decoder_set_output_RGBA8(FLIF_DECODER* decoder, void* pixels, uint32_t width, uint32_t height, size_t stride);
+    FLIF_DLLIMPORT void FLIF_API flif_decoder_set_output_RGBA16(FLIF_DECODER* decoder, void* pixels, uint32_t width, uint32_t height, size_t stride);
 
     // Progressive decoding: set a callback function. The callback will be called after a certain quality is reached,
     // and it should return the desired next quality that should be reached before it will be called again.
@@ -76,6 +99,11 @@ extern "C" {
     FLIF_DLLIMPORT void FLIF_API flif_decoder_set_callback(FLIF_DECODER* decoder, callback_t callback, void *user_data);
     FLIF_DLLIMPORT void FLIF_API flif_decoder_set_first_callback_quality(FLIF_DECODER* decoder, int32_t quality); // valid quality: 0-10000
 
+    // Collect statistics (see FLIF_STATS) while decoding; default: no (0).
+    FLIF_DLLIMPORT void FLIF_API flif_decoder_set_stats(FLIF_DECODER* decoder, int32_t stats);
+    // Statistics of the last decode, owned by the decoder; NULL if they are not collected.
+    FLIF_DLLIMPORT FLIF_STATS* FLIF_API flif_decoder_get_stats(FLIF_DECODER* decoder);
+
     // Reads the header of a FLIF file and packages it as a FLIF_INFO struct.
     // May return a null pointer if the file is not in the right format.
     // The caller takes ownership of the return value and must call flif_destroy_info().
@@ -83,6 +111,12 @@ extern "C" {
     // deallocator function for FLIF_INFO
     FLIF_DLLIMPORT void FLIF_API flif_destroy_info(FLIF_INFO* info);
 
+    // Returns how many bytes at the start of a FLIF file are enough to decode it at the given scale (1,2,4,...,128)
+    // and quality (0-100), so that prefix can be served instead of the whole file. Nothing is decoded: the offsets
+    // come from the truncation index written by the encoder (see flif_encoder_set_truncation_index).
+    // Returns 0 if the file has no truncation index.
+    FLIF_DLLIMPORT size_t FLIF_API flif_truncate_memory(const void* buffer, size_t buffer_size_bytes, uint32_t scale, int32_t quality);
+
     // get the image width
     FLIF_DLLIMPORT uint32_t FLIF_API flif_info_get_width(FLIF_INFO* info);
     // get the image height
@@ -27,6 +27,9 @@ extern "C" {
 
     typedef struct FLIF_ENCODER FLIF_ENCODER;
 
+    // Receives the next size bytes of the encoded file; return 0 to make the encoding fail (e.g. when the stream is closed).
+    typedef int32_t (*write_callback_t)(const void* data, size_t size, void* user_data);
+
     // initialize a FLIF encoder
     FLIF_DLLIMPORT FLIF_ENCODER* FLIF_API flif_create_encoder();
 
@@ -44,12 +47,18 @@ extern "C" {
     // encode to memory (afterwards, buffer will point to the blob and buffer_size_bytes contains its size)
     FLIF_DLLIMPORT int32_t FLIF_API flif_encoder_encode_memory(FLIF_ENCODER* encoder, void** buffer, size_t* buffer_size_bytes);
 
+    // encode to a callback, which gets the file in order, in blocks of at most 64 KiB, while it is being encoded
+    // (so the encoded file is never kept in memory as a whole, except with a truncation index or tiles);
+    // user_data is passed on to the callback as it is
+    FLIF_DLLIMPORT int32_t FLIF_API flif_encoder_encode_callback(FLIF_ENCODER* encoder, write_callback_t write_callback, void* user_data);
+
     // release an encoder (has to be called to avoid memory leaks)
     FLIF_DLLIMPORT void FLIF_API flif_destroy_encoder(FLIF_ENCODER* encoder);
 
     // encoder options (these are all optional, the defaults should be fine)
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_interlaced(FLIF_ENCODER* encoder, uint32_t interlaced);      // 0 = -N, 1 = -I (default: -I)
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_learn_repeat(FLIF_ENCODER* encoder, uint32_t learn_repeats); // default: 2 (-R)
+    FLIF_DLLIMPORT void FLIF_API flif_encoder_set_learn_sample(FLIF_ENCODER* encoder, uint32_t megapixels);    // default: 4 (-a), 0 = learn from all rows
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_auto_color_buckets(FLIF_ENCODER* encoder, uint32_t acb);     // 0 = -B, 1 = default
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_palette_size(FLIF_ENCODER* encoder, int32_t palette_size);   // default: 512  (max palette size)
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_lookback(FLIF_ENCODER* encoder, int32_t lookback);           // default: 1 (-L)
@@ -66,10 +75,24 @@ extern "C" {
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_channel_compact(FLIF_ENCODER* encoder, uint32_t plc); // 0 = -C, 1 = default
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_ycocg(FLIF_ENCODER* encoder, uint32_t ycocg);         // 0 = -Y, 1 = default
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_frame_shape(FLIF_ENCODER* encoder, uint32_t frs);     // 0 = -S, 1 = default
+    FLIF_DLLIMPORT void FLIF_API flif_encoder_set_threads(FLIF_ENCODER* encoder, int32_t threads);      // default: 0 = number of cores (-j)
+    FLIF_DLLIMPORT void FLIF_API flif_encoder_set_tile_size(FLIF_ENCODER* encoder, int32_t tile_size);  // default: 0 = no tiles (-O), otherwise a multiple of 64
+    FLIF_DLLIMPORT void FLIF_API flif_encoder_set_truncation_index(FLIF_ENCODER* encoder, int32_t truncation_index); // default: 0, 1 = store offsets for flif_truncate_memory (-z)
 
     //set amount of quality loss, 0 for no loss, 100 for maximum loss, negative values indicate adaptive lossy (second image should be the saliency map)
     FLIF_DLLIMPORT void FLIF_API flif_encoder_set_lossy(FLIF_ENCODER* encoder, int32_t loss);           // default: 0 (lossless)
 
+    // Collect statistics (see FLIF_STATS) while encoding; default: no (0).
+    FLIF_DLLIMPORT void FLIF_API flif_encoder_set_stats(FLIF_ENCODER* encoder, int32_t stats);
+    // Statistics of the last encode, owned by the encoder; NULL if they are not collected.
+    FLIF_DLLIMPORT FLIF_STATS* FLIF_API flif_encoder_get_stats(FLIF_ENCODER* encoder);
+
+    // Start from the pretrained MANIAC trees in a dictionary file (made with flif --make-dictionary) instead of
+    // learning the trees from scratch; use it with learn_repeat 1 or 0 to save most of the learning time.
+    // Decoding does not need the dictionary.
+    // Returns 1 on success, 0 if the file could not be loaded.
+    FLIF_DLLIMPORT int32_t FLIF_API flif_encoder_set_dictionary(FLIF_ENCODER* encoder, const char* filename);
+
 
 
 #ifdef __cplusplus
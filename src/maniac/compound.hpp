@@ -95,22 +95,24 @@ public:
 
 
 template <typename BitChance, typename RAC, int bits> class FinalCompoundSymbolCoder {
-private:
+public:
     typedef typename FinalCompoundSymbolBitCoder<BitChance, RAC, bits>::Table Table;
+private:
     RAC &rac;
-    const Table table;
+    std::shared_ptr<const Table> table;
 
 public:
 
-    FinalCompoundSymbolCoder(RAC& racIn, int cut = 2, int alpha = 0xFFFFFFFF / 19) : rac(racIn), table(cut,alpha) {}
+    FinalCompoundSymbolCoder(RAC& racIn, int cut = 2, int alpha = 0xFFFFFFFF / 19, std::shared_ptr<const Table> tableIn = nullptr) :
+        rac(racIn), table(tableIn ? std::move(tableIn) : std::make_shared<Table>(cut,alpha)) {}
 
     int read_int(FinalCompoundSymbolChances<BitChance, bits> &chancesIn, int min, int max) {
-        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, rac, chancesIn);
+        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, rac, chancesIn);
         int val = reader<bits>(bitCoder, min, max);
         return val;
     }
     int read_int(FinalCompoundSymbolChances<BitChance, bits> &chancesIn, int nbits) {
-        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, rac, chancesIn);
+        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, rac, chancesIn);
         int val = reader(bitCoder, nbits);
         return val;
     }
@@ -124,16 +126,27 @@ public:
 
 
 template <typename BitChance, typename RAC, int bits> class FinalPropertySymbolCoder {
+public:
+    typedef typename FinalCompoundSymbolCoder<BitChance, RAC, bits>::Table Table;
+    typedef FinalCompoundSymbolChances<BitChance,bits> Leaf;
 private:
     FinalCompoundSymbolCoder<BitChance, RAC, bits> coder;
     //Ranges range;
     unsigned int nb_properties;
     std::vector<FinalCompoundSymbolChances<BitChance,bits> > leaf_node;
-    Tree &inner_node;
+    BufferPool<Leaf> *leaf_pool; // where leaf_node comes from and goes back to, if not NULL
+    // private copy of the tree: one contiguous array per coder, counts are updated in place
+    Tree tree;
+    // number of symbols coded and inner nodes visited to find their leaves (for FLIF_STATS)
+    uint64_t nb_symbols;
+    uint64_t nb_visited;
 
     FinalCompoundSymbolChances<BitChance,bits> inline &find_leaf(const Properties &properties) ATTRIBUTE_HOT {
-        Tree::size_type pos = 0;
+        PropertyDecisionNode *inner_node = tree.data();
+        uint32_t pos = 0;
+        nb_symbols++;
         while(inner_node[pos].property != -1) {
+            nb_visited++;
             if (inner_node[pos].count < 0) {
                 if (properties[inner_node[pos].property] > inner_node[pos].splitval) {
                   pos = inner_node[pos].childID;
@@ -165,14 +178,23 @@ private:
     }
 
 public:
-    FinalPropertySymbolCoder(RAC& racIn, Ranges &rangeIn, Tree &treeIn, int FLIF_UNUSED(ignored_split_threshold) = 0, int cut = 4, int alpha = 0xFFFFFFFF / 20) :
-        coder(racIn, cut, alpha),
+    FinalPropertySymbolCoder(RAC& racIn, Ranges &rangeIn, Tree &treeIn, int FLIF_UNUSED(ignored_split_threshold) = 0, int cut = 4, int alpha = 0xFFFFFFFF / 20,
+                             std::shared_ptr<const Table> table = nullptr, BufferPool<Leaf> *leaves = NULL) :
+        coder(racIn, cut, alpha, std::move(table)),
 //        range(rangeIn),
         nb_properties(rangeIn.size()),
-        leaf_node(1,FinalCompoundSymbolChances<BitChance,bits>()),
-        inner_node(treeIn) 
+        leaf_pool(leaves),
+        tree(treeIn), nb_symbols(0), nb_visited(0)
     {
-        inner_node[0].leafID = 0;
+        // every inner node splits a leaf in two when its count runs out, so this is all the leaves there will be
+        const size_t nb_leaves = (tree.size() + 1) / 2;
+        if (leaf_pool) leaf_node = leaf_pool->take(nb_leaves);
+        leaf_node.assign(1, FinalCompoundSymbolChances<BitChance,bits>());
+        leaf_node.reserve(nb_leaves);
+        tree[0].leafID = 0;
+    }
+    ~FinalPropertySymbolCoder() {
+        if (leaf_pool) leaf_pool->give(std::move(leaf_node));
     }
 
     int read_int(const Properties &properties, int min, int max) ATTRIBUTE_HOT {
@@ -189,6 +211,9 @@ public:
         return coder.read_int(chances, nbits);
     }
 
+    uint64_t symbols() const { return nb_symbols; }
+    uint64_t visited_nodes() const { return nb_visited; }
+
 #ifdef HAS_ENCODER
     void write_int(const Properties &properties, int min, int max, int val);
     void write_int(const Properties &properties, int nbits, int val);
@@ -209,8 +234,8 @@ private:
     unsigned int nb_properties;
 
 public:
-    MetaPropertySymbolCoder(RAC &racIn, const Ranges &rangesIn, int cut = 2, int alpha = 0xFFFFFFFF / 19) :
-        coder(3,Coder(racIn, cut, alpha)),
+    MetaPropertySymbolCoder(RAC &racIn, const Ranges &rangesIn, int cut = 2, int alpha = 0xFFFFFFFF / 19, std::shared_ptr<const typename BitChance::Table> table = nullptr) :
+        coder(3,Coder(racIn, cut, alpha, std::move(table))),
         range(rangesIn),
         nb_properties(rangesIn.size())
     {
@@ -112,13 +112,13 @@ public:
 
 template <typename BitChance, typename RAC, int bits>
 void FinalCompoundSymbolCoder<BitChance,RAC,bits>::write_int(FinalCompoundSymbolChances<BitChance, bits>& chancesIn, int min, int max, int val) {
-        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, rac, chancesIn);
+        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, rac, chancesIn);
         writer<bits>(bitCoder, min, max, val);
     }
 
 template <typename BitChance, typename RAC, int bits>
 void FinalCompoundSymbolCoder<BitChance,RAC,bits>::write_int(FinalCompoundSymbolChances<BitChance, bits>& chancesIn, int nbits, int val) {
-        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, rac, chancesIn);
+        FinalCompoundSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, rac, chancesIn);
         writer(bitCoder, nbits, val);
     }
 
@@ -265,6 +265,15 @@ public:
         inner_node(treeIn),
         selection(nb_properties,false),
         split_threshold(st) {
+        // learning can start from a given (pretrained) tree: every leaf gets its own statistics
+        if (inner_node.size() > 1) {
+            leaf_node.clear();
+            for (PropertyDecisionNode &n : inner_node) {
+                if (n.property != -1) continue;
+                n.leafID = leaf_node.size();
+                leaf_node.push_back(CompoundSymbolChances<BitChance,bits>(nb_properties));
+            }
+        }
     }
 
     int read_int(Properties &properties, int min, int max) {
@@ -341,6 +350,9 @@ public:
     uint64_t compute_total_size() {
         return compute_total_size_subtree(0);
     }
+    // only the final pass is counted in FLIF_STATS
+    static uint64_t symbols() { return 0; }
+    static uint64_t visited_nodes() { return 0; }
 };
 
 
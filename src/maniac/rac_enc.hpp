@@ -76,6 +76,11 @@ public:
     void inline write_bit(bool bit) {
         put(range >> 1, bit);
     }
+    // number of bytes a decoder has read from io once it has decoded everything written so far:
+    // it reads MAX_RANGE_BITS/8 bytes ahead, and some generated bytes are still held back here
+    long decoder_position() {
+        return io.ftell() + (delayed_byte >= 0) + delayed_count + Config::MAX_RANGE_BITS/8;
+    }
 
     void inline flush() {
         low += (Config::MIN_RANGE - 1);
@@ -98,6 +103,7 @@ public:
     static void inline write_12bit_chance(FLIF_UNUSED(uint16_t b12), bool) { }
     static void inline write_bit(bool) { }
     static void inline flush() { }
+    static long decoder_position() { return 0; }
 };
 
 
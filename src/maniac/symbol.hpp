@@ -19,6 +19,7 @@ limitations under the License.
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <assert.h>
 #include "util.hpp"
 #include "chance.hpp"
@@ -250,11 +251,12 @@ template <typename BitChance, typename RAC, int bits> class SimpleSymbolCoder {
 
 private:
     SymbolChance<BitChance,bits> ctx;
-    const Table table;
+    std::shared_ptr<const Table> table; // shared by the copies of a coder, and with other coders if it is given
     RAC &rac;
 
 public:
-    SimpleSymbolCoder(RAC& racIn, int cut = 2, int alpha = 0xFFFFFFFF / 19) :  table(cut,alpha), rac(racIn) {
+    SimpleSymbolCoder(RAC& racIn, int cut = 2, int alpha = 0xFFFFFFFF / 19, std::shared_ptr<const Table> tableIn = nullptr) :
+        table(tableIn ? std::move(tableIn) : std::make_shared<Table>(cut,alpha)), rac(racIn) {
     }
 
 #ifdef HAS_ENCODER
@@ -271,7 +273,7 @@ public:
 #endif
 
     int read_int(int min, int max) {
-        SimpleSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, ctx, rac);
+        SimpleSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, ctx, rac);
         return reader<bits, SimpleSymbolBitCoder<BitChance, RAC, bits>>(bitCoder, min, max);
     }
     int read_int2(int min, int max) {
@@ -284,7 +286,7 @@ public:
     }
     int read_int(int nbits) {
         assert (nbits <= bits);
-        SimpleSymbolBitCoder<BitChance, RAC, bits> bitCoder(table, ctx, rac);
+        SimpleSymbolBitCoder<BitChance, RAC, bits> bitCoder(*table, ctx, rac);
         return reader(bitCoder, nbits);
     }
 };
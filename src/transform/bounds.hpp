@@ -24,12 +24,17 @@ limitations under the License.
 #include "transform.hpp"
 #include "../maniac/symbol.hpp"
 
-class ColorRangesBounds final : public ColorRanges {
+// ranges_t is the type of the underlying ranges; the decoder uses a concrete (final) type there
+// to turn the calls into the underlying ranges into direct calls
+template <typename ranges_t>
+class ColorRangesBoundsOf final : public ColorRanges {
 protected:
     const std::vector<std::pair<ColorVal, ColorVal> > bounds;
-    const ColorRanges *ranges;
+    const ranges_t *ranges;
 public:
-    ColorRangesBounds(const std::vector<std::pair<ColorVal, ColorVal> > &boundsIn, const ColorRanges *rangesIn) : bounds(boundsIn), ranges(rangesIn) {}
+    ColorRangesBoundsOf(const std::vector<std::pair<ColorVal, ColorVal> > &boundsIn, const ranges_t *rangesIn) : bounds(boundsIn), ranges(rangesIn) {}
+    const std::vector<std::pair<ColorVal, ColorVal> > &getBounds() const { return bounds; }
+    const ranges_t *getRanges() const { return ranges; }
     bool isStatic() const override { return false; }
     int numPlanes() const override { return bounds.size(); }
     ColorVal min(int p) const override { assert(p<numPlanes()); return std::max(ranges->min(p), bounds[p].first); }
@@ -64,6 +69,8 @@ public:
     }
 };
 
+typedef ColorRangesBoundsOf<ColorRanges> ColorRangesBounds;
+
 
 template <typename IO>
 class TransformBounds : public Transform<IO> {
@@ -72,6 +79,7 @@ protected:
 
     bool undo_redo_during_decode() override { return false; }
 
+    bool inv_row_wise() const override { return true; } // nothing to undo on the pixels
     const ColorRanges *meta(Images&, const ColorRanges *srcRanges) override {
         if (srcRanges->isStatic()) {
             return new StaticColorRanges(bounds);
@@ -22,6 +22,9 @@ limitations under the License.
 
 #include "transform.hpp"
 #include "../maniac/symbol.hpp"
+#ifdef HAS_ENCODER
+#include "colorhash.hpp"
+#endif
 
 
 #define MAX_PER_BUCKET_0 255
@@ -334,6 +337,7 @@ protected:
 
     bool undo_redo_during_decode() override { return false; }
 
+    bool inv_row_wise() const override { return true; } // nothing to undo on the pixels
     const ColorRanges* meta(Images&, const ColorRanges *srcRanges) override {
 //        cb->print();
 
@@ -542,12 +546,23 @@ protected:
         }
     }
 
-    bool process(FLIF_UNUSED(const ColorRanges *srcRanges), const Images &images) override {
+    bool process(const ColorRanges *srcRanges, const Images &images) override {
             std::vector<ColorVal> pixel(images[0].numPlanes());
+            // adding a color to the buckets a second time does not change them, so a small direct-mapped cache
+            // of the colors that were added already can skip most of the work
+            ColorPacker packer;
+            const bool packed = packer.init(srcRanges, images[0].numPlanes());
+            std::vector<uint64_t> added(packed ? 4096 : 0, TRANSPARENT_COLOR - 1); // never a valid key
             // fill buckets
             for (const Image& image : images)
             for (uint32_t r=0; r<image.rows(); r++) {
                 for (uint32_t c=0; c<image.cols(); c++) {
+                  uint64_t k;
+                  if (packed && packer.pack(image, r, c, k)) {
+                    uint64_t &slot = added[(k * 0x9E3779B97F4A7C15ULL) >> 52];
+                    if (slot == k) continue;
+                    slot = k;
+                  }
                   int p;
                   for (p=0; p<image.numPlanes(); p++) {
                     ColorVal v = image(p,r,c);
@@ -0,0 +1,154 @@
+/*
+FLIF - Free Lossless Image Format
+
+Copyright 2010-2016, Jon Sneyers & Pieter Wuille
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+// Helpers for the encoder-side analysis of the transforms: packing pixels into 64-bit keys and hashing them.
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "../image/image.hpp"
+#include "../image/color_range.hpp"
+#include "../maniac/util.hpp"
+#include "../common.hpp"
+
+// key of all fully transparent pixels (if alpha_zero_special), never the key of a visible pixel
+#define TRANSPARENT_COLOR (~(uint64_t)0)
+
+// Packs the first (up to 4) planes of a pixel into a 64-bit key, with an offset and bit width per plane taken from the ranges.
+class ColorPacker {
+    int nump;
+    ColorVal offset[4];
+    ColorVal limit[4];
+    int shift[4];
+    uint64_t mask[4];
+
+public:
+    // returns false if the values do not fit in 63 bits
+    bool init(const ColorRanges *ranges, const int numPlanes) {
+        nump = std::min(numPlanes, 4);
+        int bits = 0;
+        for (int p = 0; p < nump; p++) {
+            offset[p] = ranges->min(p);
+            limit[p] = ranges->max(p);
+            shift[p] = bits;
+            const int width = (limit[p] > offset[p] ? maniac::util::ilog2(limit[p] - offset[p]) + 1 : 0);
+            mask[p] = ((uint64_t)1 << width) - 1;
+            bits += width;
+        }
+        return bits < 64;
+    }
+
+    // returns false if a value is not within the ranges (which can happen for invisible pixels)
+    bool pack(const ColorVal *values, uint64_t &key) const {
+        key = 0;
+        for (int p = 0; p < nump; p++) {
+            if (values[p] < offset[p] || values[p] > limit[p]) return false;
+            key |= (uint64_t)(values[p] - offset[p]) << shift[p];
+        }
+        return true;
+    }
+    bool pack(const Image &image, const uint32_t r, const uint32_t c, uint64_t &key) const {
+        if (nump > 3 && image.alpha_zero_special && image(3,r,c) == 0) { key = TRANSPARENT_COLOR; return true; }
+        ColorVal values[4];
+        for (int p = 0; p < nump; p++) values[p] = image(p,r,c);
+        return pack(values, key);
+    }
+
+    // value of plane p in a (non-transparent) key
+    ColorVal unpack(const uint64_t key, const int p) const { return offset[p] + (ColorVal)((key >> shift[p]) & mask[p]); }
+};
+
+// Open-addressing hash table that numbers the keys in order of first insertion.
+class ColorHashTable {
+    struct Entry { uint64_t key; int32_t index; };
+    std::vector<Entry> table;
+    std::vector<uint64_t> keys;
+    int bits;
+
+    size_t slot(const uint64_t key) const { return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits); }
+    void grow() {
+        bits++;
+        table.assign((size_t)1 << bits, Entry{0, -1});
+        for (size_t i = 0; i < keys.size(); i++) {
+            size_t s = slot(keys[i]);
+            while (table[s].index >= 0) s = (s + 1) & (table.size() - 1);
+            table[s] = Entry{keys[i], (int32_t)i};
+        }
+    }
+
+public:
+    ColorHashTable() : table(256, Entry{0, -1}), bits(8) {}
+
+    // returns the index of the key, adding it if it is new
+    int32_t insert(const uint64_t key) {
+        for (size_t s = slot(key);; s = (s + 1) & (table.size() - 1)) {
+            if (table[s].index < 0) {
+                table[s] = Entry{key, (int32_t)keys.size()};
+                keys.push_back(key);
+                if (keys.size() * 2 > table.size()) grow();
+                return keys.size() - 1;
+            }
+            if (table[s].key == key) return table[s].index;
+        }
+    }
+    // returns the index of the key, or -1 if it is not in the table
+    int32_t find(const uint64_t key) const {
+        for (size_t s = slot(key);; s = (s + 1) & (table.size() - 1)) {
+            if (table[s].index < 0) return -1;
+            if (table[s].key == key) return table[s].index;
+        }
+    }
+    size_t size() const { return keys.size(); }
+    const std::vector<uint64_t> & ordered_keys() const { return keys; }
+};
+
+// Finds the distinct colors of the images, in order of first occurrence (frame by frame, row by row).
+// key(image, r, c, k) sets k to the key of a pixel, or returns false if the pixel has to be skipped.
+// Returns false as soon as there are more than max_colors distinct colors.
+// The rows are split in one contiguous part per thread, and the parts are merged in order,
+// so the result does not depend on the number of threads.
+template <typename Key>
+bool find_distinct_colors(const Images &images, const size_t max_colors, Key key, ColorHashTable &colors) {
+    const size_t rows = images[0].rows(), total = images.size() * rows;
+    if (total == 0) return true;
+    const size_t nb_parts = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), total);
+    std::vector<ColorHashTable> parts(nb_parts);
+    std::atomic<bool> too_many(false);
+    parallel_for(nb_parts, nb_parts, [&](size_t part) {
+        ColorHashTable &local = parts[part];
+        for (size_t i = total * part / nb_parts; i < total * (part + 1) / nb_parts && !too_many; i++) {
+            const Image &image = images[i / rows];
+            const uint32_t r = i % rows;
+            uint64_t k;
+            for (uint32_t c = 0; c < image.cols(); c++) {
+                if (key(image, r, c, k)) local.insert(k);
+            }
+            if (local.size() > max_colors) too_many = true;
+        }
+    });
+    if (too_many) return false;
+    for (const ColorHashTable &local : parts) {
+        for (uint64_t k : local.ordered_keys()) colors.insert(k);
+        if (colors.size() > max_colors) return false;
+    }
+    return true;
+}
@@ -19,8 +19,12 @@ limitations under the License.
 #pragma once
 
 #include <vector>
+#include <mutex>
 
 #include "transform.hpp"
+#ifdef HAS_ENCODER
+#include "colorhash.hpp"
+#endif
 
 
 class ColorRangesFC final : public ColorRanges {
@@ -46,6 +50,65 @@ public:
     const ColorRanges* previous() const override { return ranges; }
 };
 
+#ifdef HAS_ENCODER
+// Finds, for every pixel of every frame, the most recent earlier frame that has the same pixel value at the same position.
+// Pixels are packed into exact 64-bit keys, and for each position the frames are fed through a small hash table
+// that maps a key to the last frame where it occurred.
+// The table is shared by all columns of a row: entries of other columns are told apart by their stamp instead of clearing.
+class FrameLookbackIndex {
+    ColorPacker packer;
+    struct Entry { uint64_t key; int32_t frame; uint32_t stamp; };
+    std::vector<Entry> table;
+    int table_bits;
+    uint32_t stamp;
+
+public:
+    // returns false if the pixels do not fit in 63 bits
+    bool init(const ColorRanges *ranges, const int numPlanes) { return packer.init(ranges, numPlanes); }
+
+    // Calls found(r, lookbacks) for every row, where lookbacks[c*nb_frames + fr] is the smallest distance to an earlier
+    // frame with the same pixel at (r,c), or 0 if that distance would exceed max_lookback. Rows are processed in parallel.
+    template <typename Found>
+    void find(const Images &images, const int max_lookback, Found found) const {
+        const int nb_frames = images.size();
+        const uint32_t rows = images[0].rows(), cols = images[0].cols();
+        parallel_for(rows, 0, [&](size_t r) {
+            FrameLookbackIndex index = *this;
+            index.table_bits = maniac::util::ilog2(nb_frames) + 2;
+            index.table.assign((size_t)1 << index.table_bits, Entry{0, 0, 0});
+            index.stamp = 0;
+            std::vector<uint64_t> keys((size_t)cols * nb_frames);
+            for (int fr = 0; fr < nb_frames; fr++)
+                for (uint32_t c = 0; c < cols; c++) {
+                    uint64_t &k = keys[(size_t)c * nb_frames + fr];
+                    // a pixel outside the ranges gets a key of its own that matches nothing (packed keys are below 2^63)
+                    if (!packer.pack(images[fr], r, c, k)) k = ((uint64_t)1 << 63) | fr;
+                }
+            std::vector<int> lookbacks(keys.size(), 0);
+            for (uint32_t c = 0; c < cols; c++) {
+                index.stamp++;
+                for (int fr = 0; fr < nb_frames; fr++) {
+                    const int previous = index.update(keys[(size_t)c * nb_frames + fr], fr);
+                    if (previous >= 0 && fr - previous <= max_lookback) lookbacks[(size_t)c * nb_frames + fr] = fr - previous;
+                }
+            }
+            found(r, lookbacks);
+        });
+    }
+
+private:
+    // remembers that key occurs in frame fr, returns the previous frame where it occurred (or -1)
+    int update(const uint64_t k, const int fr) {
+        const size_t mask = table.size() - 1;
+        for (size_t i = (k * 0x9E3779B97F4A7C15ULL) >> (64 - table_bits);; i = (i + 1) & mask) {
+            Entry &e = table[i];
+            if (e.stamp != stamp) { e = Entry{k, fr, stamp}; return -1; }
+            if (e.key == k) { const int previous = e.frame; e.frame = fr; return previous; }
+        }
+    }
+};
+#endif
+
 template <typename IO>
 class TransformFrameCombine : public Transform<IO> {
 protected:
@@ -54,6 +117,10 @@ protected:
     int max_lookback;
     int user_max_lookback;
     int nb_frames;
+#ifdef HAS_ENCODER
+    FrameLookbackIndex lookback_index;
+    bool use_lookback_index;
+#endif
 
     bool undo_redo_during_decode() override { return true; }
 
@@ -98,6 +165,26 @@ protected:
         uint64_t new_pixels=0;
         max_lookback=1;
         if (user_max_lookback == -1) user_max_lookback = images.size()-1;
+        use_lookback_index = lookback_index.init(srcRanges, nump);
+        if (use_lookback_index) {
+            std::mutex lock;
+            lookback_index.find(images, user_max_lookback, [&](uint32_t r, const std::vector<int> &lookbacks) {
+                std::vector<uint64_t> found(images.size(), 0);
+                uint64_t found_new = 0;
+                for (int fr=1; fr < nb_frames; fr++) {
+                    for (uint32_t c=images[fr].col_begin[r]; c<images[fr].col_end[r]; c++) {
+                        const int prev = lookbacks[(size_t)c * nb_frames + fr];
+                        if (prev) found[prev]++; else found_new++;
+                    }
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                new_pixels += found_new;
+                for (int prev=1; prev < nb_frames; prev++) {
+                    found_pixels[prev] += found[prev];
+                    if (found[prev] && prev>max_lookback) max_lookback=prev;
+                }
+            });
+        } else
         for (int fr=1; fr < (int)images.size(); fr++) {
             const Image& image = images[fr];
             for (uint32_t r=0; r<image.rows(); r++) {
@@ -131,6 +218,18 @@ protected:
         return (found_pixels[0] * pixel_cost > new_pixels * (2 + max_lookback));
     };
     void data(Images &images) const override {
+        if (use_lookback_index) {
+            lookback_index.find(images, max_lookback, [&](uint32_t r, const std::vector<int> &lookbacks) {
+                for (int fr=1; fr < nb_frames; fr++) {
+                    Image& image = images[fr];
+                    for (uint32_t c=image.col_begin[r]; c<image.col_end[r]; c++) {
+                        const int prev = lookbacks[(size_t)c * nb_frames + fr];
+                        if (prev) image.set(4,r,c, prev);
+                    }
+                }
+            });
+            return;
+        }
         for (int fr=1; fr < (int)images.size(); fr++) {
             uint32_t ipixels=0;
             Image& image = images[fr];
@@ -24,6 +24,7 @@ limitations under the License.
 #include <tuple>
 #ifdef HAS_ENCODER
 #include <set>
+#include "colorhash.hpp"
 #endif
 
 #define MAX_PALETTE_SIZE 30000
@@ -57,6 +58,10 @@ protected:
     unsigned int max_palette_size;
     bool ordered_palette;
     bool has_alpha;
+#ifdef HAS_ENCODER
+    ColorPacker packer;
+    bool packed;
+#endif
 
 public:
     // if the image also has alpha, this transform is not a 'real' palette transform
@@ -84,6 +89,17 @@ public:
         int nb_colors = Palette_vector.size();
         return new ColorRangesPalette(srcRanges, nb_colors);
     }
+    bool inv_row_wise() const override { return true; }
+    void invData_row(ColorVal **row, const int, const uint32_t cols) const override {
+        for (uint32_t c=0; c<cols; c++) {
+            int P=row[1][c];
+            if (P < 0 || P >= (int) Palette_vector.size()) P = 0; // might happen on invisible pixels with predictor -H1
+            const Color &value = Palette_vector[P];
+            row[0][c] = std::get<0>(value);
+            row[1][c] = std::get<1>(value);
+            row[2][c] = std::get<2>(value);
+        }
+    }
     void invData(Images& images, uint32_t strideCol, uint32_t strideRow) const override {
 //        v_printf(5,"invData Palette\n");
         for (Image& image : images) {
@@ -111,8 +127,17 @@ public:
     }
 
 #ifdef HAS_ENCODER
-    bool process(const ColorRanges *, const Images &images) override {
-        if (ordered_palette) {
+    bool process(const ColorRanges *srcRanges, const Images &images) override {
+        packed = packer.init(srcRanges, 3);
+        if (packed) {
+          ColorHashTable colors;
+          if (!find_distinct_colors(images, max_palette_size, [this](const Image &image, uint32_t r, uint32_t c, uint64_t &k) {
+                  if (image.alpha_zero_special && image.numPlanes()>3 && image(3,r,c)==0) return false;
+                  return packer.pack(image, r, c, k);
+              }, colors)) return false;
+          for (uint64_t k : colors.ordered_keys()) Palette_vector.push_back(Color(packer.unpack(k,0), packer.unpack(k,1), packer.unpack(k,2)));
+          if (ordered_palette) std::sort(Palette_vector.begin(), Palette_vector.end());
+        } else if (ordered_palette) {
           std::set<Color> Palette;
           for (const Image& image : images)
           for (uint32_t r=0; r<image.rows(); r++) {
@@ -145,12 +170,25 @@ public:
     }
     void data(Images& images) const override {
 //        printf("TransformPalette::data\n");
+        ColorHashTable index;
+        if (packed) for (const Color &C : Palette_vector) {
+            ColorVal values[3] = {std::get<0>(C), std::get<1>(C), std::get<2>(C)};
+            uint64_t k;
+            packer.pack(values, k);
+            index.insert(k);
+        }
         for (Image& image : images) {
           for (uint32_t r=0; r<image.rows(); r++) {
             for (uint32_t c=0; c<image.cols(); c++) {
-                Color C(image(0,r,c), image(1,r,c), image(2,r,c));
                 ColorVal P=0;
-                for (Color c : Palette_vector) {if (c==C) break; else P++;} // slow for large palettes
+                uint64_t k;
+                if (packed) {
+                    P = (packer.pack(image, r, c, k) ? index.find(k) : -1);
+                    if (P < 0) P = Palette_vector.size(); // invisible pixel with a color that is not in the palette
+                } else {
+                    Color C(image(0,r,c), image(1,r,c), image(2,r,c));
+                    for (Color c : Palette_vector) {if (c==C) break; else P++;} // slow for large palettes
+                }
                 image.set(0,r,c, 0);
                 image.set(1,r,c, P);
 //                image.set(2,r,c, 0);
@@ -23,6 +23,9 @@ limitations under the License.
 #include "transform.hpp"
 #include <tuple>
 #include <set>
+#ifdef HAS_ENCODER
+#include "colorhash.hpp"
+#endif
 
 #define MAX_PALETTE_SIZE 30000
 
@@ -64,6 +67,21 @@ protected:
     bool alpha_zero_special;
     bool ordered_palette;
     bool already_has_palette;
+#ifdef HAS_ENCODER
+    ColorPacker packer;
+    bool packed;
+
+    // key of a pixel, all invisible pixels share the same key
+    bool pack(const ColorVal Y, const ColorVal I, const ColorVal Q, const ColorVal A, uint64_t &k) const {
+        if (alpha_zero_special && A==0) { k = TRANSPARENT_COLOR; return true; }
+        const ColorVal values[4] = {Y, I, Q, A};
+        return packer.pack(values, k);
+    }
+    Color unpack(const uint64_t k) const {
+        if (k == TRANSPARENT_COLOR) return Color(0,0,0,0);
+        return Color(packer.unpack(k,3), packer.unpack(k,0), packer.unpack(k,1), packer.unpack(k,2));
+    }
+#endif
 
 public:
     bool is_palette_transform() const override { return true; }
@@ -89,6 +107,18 @@ public:
         return new ColorRangesPaletteA(srcRanges, Palette_vector.size());
     }
 
+    bool inv_row_wise() const override { return true; }
+    void invData_row(ColorVal **row, const int, const uint32_t cols) const override {
+        for (uint32_t c=0; c<cols; c++) {
+            int P=row[1][c];
+            assert(P < (int) Palette_vector.size());
+            const Color &value = Palette_vector[P];
+            row[0][c] = std::get<1>(value);
+            row[1][c] = std::get<2>(value);
+            row[2][c] = std::get<3>(value);
+            row[3][c] = std::get<0>(value);
+        }
+    }
     void invData(Images& images, uint32_t strideCol, uint32_t strideRow) const override {
         for (Image& image : images) {
           image.undo_make_constant_plane(0);
@@ -117,6 +147,7 @@ public:
 #if HAS_ENCODER
     bool process(const ColorRanges *srcRanges, const Images &images) override {
         if (images[0].alpha_zero_special) alpha_zero_special = true; else alpha_zero_special = false;
+        packed = false;
         if (images[0].palette && images[0].palette_image) {
             // image is already a palette image
             Image& image = *images[0].palette_image;
@@ -145,7 +176,15 @@ public:
             already_has_palette = true;
             return true;
         }
-        if (ordered_palette) {
+        packed = packer.init(srcRanges, 4);
+        if (packed) {
+          ColorHashTable colors;
+          if (!find_distinct_colors(images, max_palette_size, [this](const Image &image, uint32_t r, uint32_t c, uint64_t &k) {
+                  return pack(image(0,r,c), image(1,r,c), image(2,r,c), image(3,r,c), k);
+              }, colors)) return false;
+          for (uint64_t k : colors.ordered_keys()) Palette_vector.push_back(unpack(k));
+          if (ordered_palette) std::sort(Palette_vector.begin(), Palette_vector.end());  // same order as the std::set below
+        } else if (ordered_palette) {
           std::set<Color> Palette;
           for (const Image& image : images)
           for (uint32_t r=0; r<image.rows(); r++) {
@@ -186,13 +225,25 @@ public:
     void data(Images& images) const override {
         if (already_has_palette) return;
 //        printf("TransformPalette::data\n");
+        ColorHashTable index;
+        if (packed) for (const Color &C : Palette_vector) {
+            uint64_t k;
+            pack(std::get<1>(C), std::get<2>(C), std::get<3>(C), std::get<0>(C), k);
+            index.insert(k);
+        }
         for (Image& image : images) {
           for (uint32_t r=0; r<image.rows(); r++) {
             for (uint32_t c=0; c<image.cols(); c++) {
-                Color C(image(3,r,c), image(0,r,c), image(1,r,c), image(2,r,c));
-                if (alpha_zero_special && std::get<0>(C) == 0) { std::get<1>(C) = std::get<2>(C) = std::get<3>(C) = 0; }
                 ColorVal P=0;
-                for (Color c : Palette_vector) {if (c==C) break; else P++;}
+                uint64_t k;
+                if (packed) {
+                    P = (pack(image(0,r,c), image(1,r,c), image(2,r,c), image(3,r,c), k) ? index.find(k) : -1);
+                    if (P < 0) P = Palette_vector.size();
+                } else {
+                    Color C(image(3,r,c), image(0,r,c), image(1,r,c), image(2,r,c));
+                    if (alpha_zero_special && std::get<0>(C) == 0) { std::get<1>(C) = std::get<2>(C) = std::get<3>(C) = 0; }
+                    for (Color c : Palette_vector) {if (c==C) break; else P++;}
+                }
                 image.set(0,r,c, 0);
                 image.set(1,r,c, P);
 //                image.set(2,r,c, 0);
@@ -22,7 +22,6 @@ limitations under the License.
 #include "../image/color_range.hpp"
 #include "transform.hpp"
 #include <tuple>
-#include <set>
 
 
 class ColorRangesPaletteC final : public ColorRanges {
@@ -68,6 +67,18 @@ public:
         return new ColorRangesPaletteC(srcRanges, nb);
     }
 
+    bool inv_row_wise() const override { return true; }
+    void invData_row(ColorVal **row, const int nump, const uint32_t cols) const override {
+        for (int p=0; p<nump; p++) {
+            const std::vector<ColorVal> &palette = CPalette_vector[p];
+            const int palette_size = palette.size();
+            for (uint32_t c=0; c<cols; c++) {
+                int P=row[p][c];
+                if (P < 0 || P >= palette_size) P = 0; // might happen on invisible pixels with predictor -H1
+                row[p][c] = palette[P];
+            }
+        }
+    }
     void invData(Images& images, FLIF_UNUSED(uint32_t strideCol), FLIF_UNUSED(uint32_t strideRow)) const override {
         for (Image& image : images) {
 
@@ -98,17 +109,20 @@ public:
 
         if (images[0].palette) return false; // skip if the image is already a palette image
 
-        std::set<ColorVal> CPalette;
+        std::vector<ColorVal> CPalette;
         bool nontrivial=false;
         for (int p=0; p<srcRanges->numPlanes(); p++) {
-         if (p==3) CPalette.insert(0); // ensure that A=0 is still A=0 even if image does not contain zero-alpha pixels
+         // mark the values that occur (the values are within 0..max), then collect them in order
+         std::vector<bool> present(srcRanges->max(p)+1, false);
+         if (p==3) present[0] = true; // ensure that A=0 is still A=0 even if image does not contain zero-alpha pixels
          for (const Image& image : images) {
           for (uint32_t r=0; r<image.rows(); r++) {
             for (uint32_t c=0; c<image.cols(); c++) {
-                CPalette.insert(image(p,r,c));
+                present[image(p,r,c)] = true;
             }
           }
          }
+         for (ColorVal v=0; v<(ColorVal)present.size(); v++) if (present[v]) CPalette.push_back(v);
 //         if ((int)CPalette.size() <= srcRanges->max(p)-srcRanges->min(p)) nontrivial = true;
          // if on all channels, less than 10% of the range can be compacted away, it's probably a bad idea to do the compaction
          // since the gain from a smaller RGB range will probably not compensate for the disturbing of the YIQ transform
@@ -131,21 +145,15 @@ public:
         }
         return nontrivial;
     }
-    void data(Images& images) const override {
-        for (Image& image : images) {
-         for (int p=0; p<image.numPlanes(); p++) {
+    bool is_row_wise() const override { return true; }
+    void data_row(ColorVal **row, const int nump, const uint32_t cols) const override {
+        for (int p=0; p<nump; p++) {
 //          const int stretch = (CPalette_vector[p].size()>64 ? 0 : 2);
-          for (uint32_t r=0; r<image.rows(); r++) {
-            for (uint32_t c=0; c<image.cols(); c++) {
-                ColorVal P = CPalette_inv_vector[p][image(p,r,c)];
-//                for (ColorVal x : CPalette_vector[p]) {if (x==image(p,r,c)) break; else P++;}
-//                image.set(p,r,c, P << stretch);
-                image.set(p,r,c, P);
-            }
-          }
-         }
+            const std::vector<ColorVal> &inv = CPalette_inv_vector[p];
+            for (uint32_t c=0; c<cols; c++) row[p][c] = inv[row[p][c]];
         }
     }
+    void data(Images& images) const override { data_rows<IO>({this}, images, 1); }
     void save(const ColorRanges *srcRanges, RacOut<IO> &rac) const override {
         SimpleSymbolCoder<FLIFBitChanceMeta, RacOut<IO>, 18> coder(rac);
         for (int p=0; p<srcRanges->numPlanes(); p++) {
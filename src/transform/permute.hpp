@@ -22,6 +22,7 @@ limitations under the License.
 #include "../image/image.hpp"
 #include "../image/color_range.hpp"
 #include "transform.hpp"
+#include "rowkernels.hpp"
 
 class ColorRangesPermute final : public ColorRanges {
 protected:
@@ -91,19 +92,15 @@ public:
         }
         return true;
     }
-    void data(Images& images) const override {
-        ColorVal pixel[5];
-        for (Image& image : images)
-        for (uint32_t r=0; r<image.rows(); r++) {
-            for (uint32_t c=0; c<image.cols(); c++) {
-                for (int p=0; p<ranges->numPlanes(); p++) pixel[p] = image(p,r,c);
-                image.set(0,r,c, pixel[permutation[0]]);
-                if (!subtract) { for (int p=1; p<ranges->numPlanes(); p++) image.set(p,r,c, pixel[permutation[p]]); }
-                else { for (int p=1; p<3 && p<ranges->numPlanes(); p++) image.set(p,r,c, pixel[permutation[p]] - pixel[permutation[0]]);
-                       for (int p=3; p<ranges->numPlanes(); p++) image.set(p,r,c, pixel[permutation[p]]); }
-            }
-        }
+    bool process_reads_pixels() const override { return false; }
+    bool is_row_wise() const override { return true; }
+    void data_row(ColorVal **row, const int, const uint32_t cols) const override {
+        ColorVal *in[5];
+        for (int p=0; p<ranges->numPlanes(); p++) in[p] = row[p];
+        for (int p=0; p<ranges->numPlanes(); p++) row[p] = in[permutation[p]];
+        if (subtract) for (int p=1; p<3 && p<ranges->numPlanes(); p++) row_kernels().subtract(row[p], row[0], cols);
     }
+    void data(Images& images) const override { data_rows<IO>({this}, images, 1); }
     void save(const ColorRanges *srcRanges, RacOut<IO> &rac) const override {
         SimpleSymbolCoder<SimpleBitChance, RacOut<IO>, 18> coder(rac);
         coder.write_int2(0, 1, subtract);
@@ -134,6 +131,15 @@ public:
         return true;
     }
 #define CLAMP(x,l,u) (x>u?u:(x<l?l:x))
+    bool inv_row_wise() const override { return true; }
+    void invData_row(ColorVal **row, const int, const uint32_t cols) const override {
+        ColorVal *in[5];
+        for (int p=0; p<ranges->numPlanes(); p++) in[p] = row[p];
+        for (int p=0; p<ranges->numPlanes(); p++) row[permutation[p]] = in[p];
+        if (subtract) for (int p=1; p<3 && p<ranges->numPlanes(); p++) {
+            row_kernels().add_clamp(in[p], in[0], cols, ranges->min(permutation[p]), ranges->max(permutation[p]));
+        }
+    }
     void invData(Images& images, uint32_t strideCol, uint32_t strideRow) const override {
         ColorVal pixel[5];
         for (Image& image : images) {
@@ -142,6 +148,7 @@ public:
           const uint32_t scaledCols = image.scaledCols();
 
           for (int p=0; p<ranges->numPlanes(); p++) image.undo_make_constant_plane(p);
+          if (strideCol == 1 && strideRow == 1 && image.getscale() == 0) { invData_rows(*this, image, ranges->numPlanes()); continue; }
           for (uint32_t r=0; r<scaledRows; r+=strideRow) {
             for (uint32_t c=0; c<scaledCols; c+=strideCol) {
                 for (int p=0; p<ranges->numPlanes(); p++) pixel[p] = image(p,r,c);
@@ -0,0 +1,259 @@
+/*
+FLIF - Free Lossless Image Format
+
+Copyright 2010-2016, Jon Sneyers & Pieter Wuille
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rowkernels.hpp"
+
+// runtime dispatch needs the GCC/clang target attributes and __builtin_cpu_supports
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define ROW_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ROWK_INLINE inline __attribute__((always_inline))
+#else
+#define ROWK_INLINE inline
+#endif
+
+// the >> is assumed to be an arithmetic right shift, like in the transforms themselves
+namespace scalar {
+
+static void ycocg_forward(ColorVal *r, ColorVal *g, ColorVal *b, const uint32_t n) {
+    for (uint32_t c = 0; c < n; c++) {
+        const ColorVal R = r[c], G = g[c], B = b[c];
+        r[c] = (((R + B)>>1) + G)>>1;
+        g[c] = R - B;
+        b[c] = G - ((R + B)>>1);
+    }
+}
+
+static void ycocg_inverse(ColorVal *y, ColorVal *co, ColorVal *cg, const uint32_t n, const ColorVal *max) {
+    for (uint32_t c = 0; c < n; c++) {
+        const ColorVal Y = y[c], Co = co[c], Cg = cg[c];
+        const ColorVal G = Y - ((-Cg)>>1);
+        const ColorVal B = Y + ((1-Cg)>>1) - (Co>>1);
+        const ColorVal R = Co + B;
+        y[c] = (R < 0 ? 0 : (R > max[0] ? max[0] : R));
+        co[c] = (G < 0 ? 0 : (G > max[1] ? max[1] : G));
+        cg[c] = (B < 0 ? 0 : (B > max[2] ? max[2] : B));
+    }
+}
+
+static void subtract(ColorVal *dst, const ColorVal *src, const uint32_t n) {
+    for (uint32_t c = 0; c < n; c++) dst[c] -= src[c];
+}
+
+static void add_clamp(ColorVal *dst, const ColorVal *src, const uint32_t n, const ColorVal min, const ColorVal max) {
+    for (uint32_t c = 0; c < n; c++) {
+        const ColorVal v = dst[c] + src[c];
+        dst[c] = (v > max ? max : (v < min ? min : v));
+    }
+}
+
+// fixed channel count and sample size, so the compiler can vectorize the loop once it is inlined in a vector kernel
+template <int channels, int bytes>
+static ROWK_INLINE void deinterleave_n(const uint8_t *in, const uint32_t n, ColorVal *const *out) {
+    for (uint32_t c = 0; c < n; c++) {
+        for (int ch = 0; ch < channels; ch++) {
+            const uint8_t *s = in + (c * channels + ch) * bytes;
+            out[ch][c] = (bytes == 2 ? (ColorVal)((s[0] << 8) + s[bytes-1]) : (ColorVal)s[0]);
+        }
+    }
+}
+
+static ROWK_INLINE void deinterleave(const uint8_t *in, const uint32_t n, const int channels, const int bytes, ColorVal *const *out) {
+    switch (channels * 2 + bytes - 1) {
+        case 2: deinterleave_n<1,1>(in, n, out); break;
+        case 3: deinterleave_n<1,2>(in, n, out); break;
+        case 4: deinterleave_n<2,1>(in, n, out); break;
+        case 5: deinterleave_n<2,2>(in, n, out); break;
+        case 6: deinterleave_n<3,1>(in, n, out); break;
+        case 7: deinterleave_n<3,2>(in, n, out); break;
+        case 8: deinterleave_n<4,1>(in, n, out); break;
+        case 9: deinterleave_n<4,2>(in, n, out); break;
+        default: assert(false);
+    }
+}
+
+}
+
+#ifdef ROW_KERNELS_X86
+
+#ifdef SUPPORT_HDR
+// 32-bit lanes; SSE2 has no 32-bit min/max, so those are done with a compare and a select
+static inline __m128i sse2_min_epi32(const __m128i a, const __m128i b) {
+    const __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+static inline __m128i sse2_max_epi32(const __m128i a, const __m128i b) {
+    const __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#define ROWK_SSE_SET1  _mm_set1_epi32
+#define ROWK_SSE_ADD   _mm_add_epi32
+#define ROWK_SSE_SUB   _mm_sub_epi32
+#define ROWK_SSE_SRA1(a) _mm_srai_epi32(a, 1)
+#define ROWK_AVX_SET1  _mm256_set1_epi32
+#define ROWK_AVX_ADD   _mm256_add_epi32
+#define ROWK_AVX_SUB   _mm256_sub_epi32
+#define ROWK_AVX_SRA1(a) _mm256_srai_epi32(a, 1)
+#define ROWK_AVX_MIN   _mm256_min_epi32
+#define ROWK_AVX_MAX   _mm256_max_epi32
+#define ROWK_SSE2_MIN  sse2_min_epi32
+#define ROWK_SSE2_MAX  sse2_max_epi32
+#define ROWK_SSE41_MIN _mm_min_epi32
+#define ROWK_SSE41_MAX _mm_max_epi32
+// for deinterleaving: bitwise operations and the even/odd 32-bit elements of a followed by those of b
+static inline __m128i sse_even32(const __m128i a, const __m128i b) {
+    return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+}
+static inline __m128i sse_odd32(const __m128i a, const __m128i b) {
+    return _mm_unpackhi_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+}
+__attribute__((target("avx2"))) static inline __m256i avx2_even32(const __m256i a, const __m256i b) {
+    const __m256i e = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm256_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+    return _mm256_permute4x64_epi64(e, _MM_SHUFFLE(3,1,2,0));
+}
+__attribute__((target("avx2"))) static inline __m256i avx2_odd32(const __m256i a, const __m256i b) {
+    const __m256i o = _mm256_unpackhi_epi64(_mm256_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm256_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+    return _mm256_permute4x64_epi64(o, _MM_SHUFFLE(3,1,2,0));
+}
+#define ROWK_SSE_AND   _mm_and_si128
+#define ROWK_SSE_OR    _mm_or_si128
+#define ROWK_SSE_SRLI  _mm_srli_epi32
+#define ROWK_SSE_SLLI  _mm_slli_epi32
+#define ROWK_SSE_EVEN32 sse_even32
+#define ROWK_SSE_ODD32  sse_odd32
+#define ROWK_AVX_AND   _mm256_and_si256
+#define ROWK_AVX_OR    _mm256_or_si256
+#define ROWK_AVX_SRLI  _mm256_srli_epi32
+#define ROWK_AVX_SLLI  _mm256_slli_epi32
+#define ROWK_AVX_EVEN32 avx2_even32
+#define ROWK_AVX_ODD32  avx2_odd32
+#else
+// 16-bit lanes
+#define ROWK_SSE_SET1  _mm_set1_epi16
+#define ROWK_SSE_ADD   _mm_add_epi16
+#define ROWK_SSE_SUB   _mm_sub_epi16
+#define ROWK_SSE_SRA1(a) _mm_srai_epi16(a, 1)
+#define ROWK_AVX_SET1  _mm256_set1_epi16
+#define ROWK_AVX_ADD   _mm256_add_epi16
+#define ROWK_AVX_SUB   _mm256_sub_epi16
+#define ROWK_AVX_SRA1(a) _mm256_srai_epi16(a, 1)
+#define ROWK_AVX_MIN   _mm256_min_epi16
+#define ROWK_AVX_MAX   _mm256_max_epi16
+#define ROWK_SSE2_MIN  _mm_min_epi16
+#define ROWK_SSE2_MAX  _mm_max_epi16
+#define ROWK_SSE41_MIN _mm_min_epi16
+#define ROWK_SSE41_MAX _mm_max_epi16
+#endif
+
+// SSE2 is part of x86-64, so it needs no target attribute
+#define ROWK_NS     sse2
+#define ROWK_TARGET
+#define ROWK_V      __m128i
+#define ROWK_LANES  (16 / sizeof(ColorVal))
+#define ROWK_LOAD(p)    _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+#define ROWK_STORE(p,v) _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v)
+#define ROWK_SET1   ROWK_SSE_SET1
+#define ROWK_ADD    ROWK_SSE_ADD
+#define ROWK_SUB    ROWK_SSE_SUB
+#define ROWK_SRA1   ROWK_SSE_SRA1
+#define ROWK_MIN    ROWK_SSE2_MIN
+#define ROWK_MAX    ROWK_SSE2_MAX
+#ifdef SUPPORT_HDR
+#define ROWK_AND    ROWK_SSE_AND
+#define ROWK_OR     ROWK_SSE_OR
+#define ROWK_SRLI   ROWK_SSE_SRLI
+#define ROWK_SLLI   ROWK_SSE_SLLI
+#define ROWK_EVEN32 ROWK_SSE_EVEN32
+#define ROWK_ODD32  ROWK_SSE_ODD32
+#endif
+#include "rowkernels_impl.hpp"
+#undef ROWK_NS
+#undef ROWK_TARGET
+#undef ROWK_MIN
+#undef ROWK_MAX
+
+#define ROWK_NS     sse41
+#define ROWK_TARGET __attribute__((target("sse4.1")))
+#define ROWK_MIN    ROWK_SSE41_MIN
+#define ROWK_MAX    ROWK_SSE41_MAX
+#include "rowkernels_impl.hpp"
+#undef ROWK_NS
+#undef ROWK_TARGET
+#undef ROWK_V
+#undef ROWK_LANES
+#undef ROWK_LOAD
+#undef ROWK_STORE
+#undef ROWK_SET1
+#undef ROWK_ADD
+#undef ROWK_SUB
+#undef ROWK_SRA1
+#undef ROWK_MIN
+#undef ROWK_MAX
+#ifdef SUPPORT_HDR
+#undef ROWK_AND
+#undef ROWK_OR
+#undef ROWK_SRLI
+#undef ROWK_SLLI
+#undef ROWK_EVEN32
+#undef ROWK_ODD32
+#endif
+
+#define ROWK_NS     avx2
+#define ROWK_TARGET __attribute__((target("avx2")))
+#define ROWK_V      __m256i
+#define ROWK_LANES  (32 / sizeof(ColorVal))
+#define ROWK_LOAD(p)    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define ROWK_STORE(p,v) _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v)
+#define ROWK_SET1   ROWK_AVX_SET1
+#define ROWK_ADD    ROWK_AVX_ADD
+#define ROWK_SUB    ROWK_AVX_SUB
+#define ROWK_SRA1   ROWK_AVX_SRA1
+#define ROWK_MIN    ROWK_AVX_MIN
+#define ROWK_MAX    ROWK_AVX_MAX
+#ifdef SUPPORT_HDR
+#define ROWK_AND    ROWK_AVX_AND
+#define ROWK_OR     ROWK_AVX_OR
+#define ROWK_SRLI   ROWK_AVX_SRLI
+#define ROWK_SLLI   ROWK_AVX_SLLI
+#define ROWK_EVEN32 ROWK_AVX_EVEN32
+#define ROWK_ODD32  ROWK_AVX_ODD32
+#endif
+#include "rowkernels_impl.hpp"
+
+#endif
+
+#define ROW_KERNELS(ns, name) RowKernels{ns::ycocg_forward, ns::ycocg_inverse, ns::subtract, ns::add_clamp, ns::deinterleave, name}
+
+static RowKernels select_row_kernels() {
+#ifdef ROW_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return ROW_KERNELS(avx2, "AVX2");
+    if (__builtin_cpu_supports("sse4.1")) return ROW_KERNELS(sse41, "SSE4.1");
+    return ROW_KERNELS(sse2, "SSE2");
+#else
+    return ROW_KERNELS(scalar, "scalar");
+#endif
+}
+
+const RowKernels & row_kernels() {
+    static const RowKernels kernels = select_row_kernels();
+    return kernels;
+}
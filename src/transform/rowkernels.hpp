@@ -0,0 +1,41 @@
+/*
+FLIF - Free Lossless Image Format
+
+Copyright 2010-2016, Jon Sneyers & Pieter Wuille
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "../image/image.hpp"
+
+// Row kernels of the color transforms (YCoCg, PermutePlanes with subtract) and of the image loaders.
+// The implementation is picked once, at run time, for the instruction sets the CPU supports
+// (AVX2, SSE4.1 or SSE2 on x86-64, plain C++ elsewhere), so one binary runs everywhere.
+struct RowKernels {
+    // R,G,B -> Y,Co,Cg in place
+    void (*ycocg_forward)(ColorVal *r, ColorVal *g, ColorVal *b, uint32_t n);
+    // Y,Co,Cg -> R,G,B in place, clipped to 0..max[p]
+    void (*ycocg_inverse)(ColorVal *y, ColorVal *co, ColorVal *cg, uint32_t n, const ColorVal *max);
+    // dst -= src
+    void (*subtract)(ColorVal *dst, const ColorVal *src, uint32_t n);
+    // dst = clamp(dst + src, min, max)
+    void (*add_clamp)(ColorVal *dst, const ColorVal *src, uint32_t n, ColorVal min, ColorVal max);
+    // splits n interleaved pixels of 1 to 4 channels into one row per channel;
+    // samples are 1 byte or 2 bytes (big-endian, as in PNG)
+    void (*deinterleave)(const uint8_t *in, uint32_t n, int channels, int bytes, ColorVal *const *out);
+    const char *name;
+};
+
+const RowKernels & row_kernels();
@@ -0,0 +1,106 @@
+/*
+FLIF - Free Lossless Image Format
+
+Copyright 2010-2016, Jon Sneyers & Pieter Wuille
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// No include guard: rowkernels.cpp includes this once per instruction set, with
+// ROWK_NS (namespace), ROWK_TARGET (function attribute), ROWK_V (vector type), ROWK_LANES
+// and the vector operations ROWK_LOAD/STORE/SET1/ADD/SUB/SRA1/MIN/MAX defined
+// (and, with 32-bit lanes, ROWK_AND/OR/SRLI/SLLI/EVEN32/ODD32 for the deinterleaving).
+// The remainder of a row that does not fill a vector is left to the scalar kernels.
+
+namespace ROWK_NS {
+
+ROWK_TARGET static void ycocg_forward(ColorVal *r, ColorVal *g, ColorVal *b, const uint32_t n) {
+    uint32_t c = 0;
+    for (; c + ROWK_LANES <= n; c += ROWK_LANES) {
+        const ROWK_V R = ROWK_LOAD(r+c), G = ROWK_LOAD(g+c), B = ROWK_LOAD(b+c);
+        const ROWK_V RB = ROWK_SRA1(ROWK_ADD(R, B));
+        ROWK_STORE(r+c, ROWK_SRA1(ROWK_ADD(RB, G)));  // Y
+        ROWK_STORE(g+c, ROWK_SUB(R, B));              // Co
+        ROWK_STORE(b+c, ROWK_SUB(G, RB));             // Cg
+    }
+    scalar::ycocg_forward(r+c, g+c, b+c, n-c);
+}
+
+ROWK_TARGET static void ycocg_inverse(ColorVal *y, ColorVal *co, ColorVal *cg, const uint32_t n, const ColorVal *max) {
+    const ROWK_V zero = ROWK_SET1(0), one = ROWK_SET1(1);
+    const ROWK_V maxR = ROWK_SET1(max[0]), maxG = ROWK_SET1(max[1]), maxB = ROWK_SET1(max[2]);
+    uint32_t c = 0;
+    for (; c + ROWK_LANES <= n; c += ROWK_LANES) {
+        const ROWK_V Y = ROWK_LOAD(y+c), Co = ROWK_LOAD(co+c), Cg = ROWK_LOAD(cg+c);
+        const ROWK_V G = ROWK_SUB(Y, ROWK_SRA1(ROWK_SUB(zero, Cg)));
+        const ROWK_V B = ROWK_SUB(ROWK_ADD(Y, ROWK_SRA1(ROWK_SUB(one, Cg))), ROWK_SRA1(Co));
+        const ROWK_V R = ROWK_ADD(Co, B);
+        ROWK_STORE(y+c, ROWK_MIN(ROWK_MAX(R, zero), maxR));
+        ROWK_STORE(co+c, ROWK_MIN(ROWK_MAX(G, zero), maxG));
+        ROWK_STORE(cg+c, ROWK_MIN(ROWK_MAX(B, zero), maxB));
+    }
+    scalar::ycocg_inverse(y+c, co+c, cg+c, n-c, max);
+}
+
+ROWK_TARGET static void subtract(ColorVal *dst, const ColorVal *src, const uint32_t n) {
+    uint32_t c = 0;
+    for (; c + ROWK_LANES <= n; c += ROWK_LANES) ROWK_STORE(dst+c, ROWK_SUB(ROWK_LOAD(dst+c), ROWK_LOAD(src+c)));
+    scalar::subtract(dst+c, src+c, n-c);
+}
+
+ROWK_TARGET static void add_clamp(ColorVal *dst, const ColorVal *src, const uint32_t n, const ColorVal min, const ColorVal max) {
+    const ROWK_V vmin = ROWK_SET1(min), vmax = ROWK_SET1(max);
+    uint32_t c = 0;
+    for (; c + ROWK_LANES <= n; c += ROWK_LANES) {
+        const ROWK_V v = ROWK_ADD(ROWK_LOAD(dst+c), ROWK_LOAD(src+c));
+        ROWK_STORE(dst+c, ROWK_MIN(ROWK_MAX(v, vmin), vmax));
+    }
+    scalar::add_clamp(dst+c, src+c, n-c, min, max);
+}
+
+// 4 channels (RGBA) with 32-bit lanes: a vector holds exactly the bytes of one pixel per lane (8-bit samples)
+// or two pixels per lane pair (16-bit samples), so the channels are unpacked with shifts and masks;
+// the other layouts are left to the compiler's vectorizer
+ROWK_TARGET static void deinterleave(const uint8_t *in, const uint32_t n, const int channels, const int bytes, ColorVal *const *out) {
+#ifdef ROWK_EVEN32
+    if (channels == 4) {
+        uint32_t c = 0;
+        const ROWK_V lo8 = ROWK_SET1(0xFF), hi8 = ROWK_SET1(0xFF00);
+        if (bytes == 1) {
+            for (; c + ROWK_LANES <= n; c += ROWK_LANES) {
+                const ROWK_V v = ROWK_LOAD(in + 4*c);
+                ROWK_STORE(out[0]+c, ROWK_AND(v, lo8));
+                ROWK_STORE(out[1]+c, ROWK_AND(ROWK_SRLI(v, 8), lo8));
+                ROWK_STORE(out[2]+c, ROWK_AND(ROWK_SRLI(v, 16), lo8));
+                ROWK_STORE(out[3]+c, ROWK_SRLI(v, 24));
+            }
+        } else {
+            for (; c + ROWK_LANES <= n; c += ROWK_LANES) {
+                const ROWK_V v0 = ROWK_LOAD(in + 8*c), v1 = ROWK_LOAD(in + 8*c + 4*ROWK_LANES);
+                const ROWK_V RG = ROWK_EVEN32(v0, v1), BA = ROWK_ODD32(v0, v1);
+                // the samples are big-endian: bytes hi,lo of the first sample, then those of the second
+                ROWK_STORE(out[0]+c, ROWK_OR(ROWK_SLLI(ROWK_AND(RG, lo8), 8), ROWK_AND(ROWK_SRLI(RG, 8), lo8)));
+                ROWK_STORE(out[1]+c, ROWK_OR(ROWK_AND(ROWK_SRLI(RG, 8), hi8), ROWK_SRLI(RG, 24)));
+                ROWK_STORE(out[2]+c, ROWK_OR(ROWK_SLLI(ROWK_AND(BA, lo8), 8), ROWK_AND(ROWK_SRLI(BA, 8), lo8)));
+                ROWK_STORE(out[3]+c, ROWK_OR(ROWK_AND(ROWK_SRLI(BA, 8), hi8), ROWK_SRLI(BA, 24)));
+            }
+        }
+        ColorVal *const rest[4] = {out[0]+c, out[1]+c, out[2]+c, out[3]+c};
+        scalar::deinterleave(in + 4*c*bytes, n-c, channels, bytes, rest);
+        return;
+    }
+#endif
+    scalar::deinterleave(in, n, channels, bytes, out);
+}
+
+}
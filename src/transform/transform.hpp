@@ -22,6 +22,10 @@ limitations under the License.
 #include "../image/color_range.hpp"
 #include "../maniac/rac.hpp"
 #include "../flif_config.h"
+#ifdef HAS_ENCODER
+#include <algorithm>
+#include "../common.hpp"
+#endif
 
 
 template <typename IO>
@@ -47,8 +51,61 @@ public:
     bool virtual process(const ColorRanges *, const Images &) { return true; };
     void virtual save(const ColorRanges *, RacOut<IO> &) const {};
     void virtual data(Images&) const {}
+    // Transforms that work pixel by pixel can also do data() one row at a time, on one buffer of cols values per plane
+    // (they may reorder the row pointers). The encoder fuses consecutive row-wise transforms into a single pass.
+    bool virtual is_row_wise() const { return false; }
+    void virtual data_row(ColorVal **, const int /*nump*/, const uint32_t /*cols*/) const {}
+    // false if process() does not look at the pixel values, so pending row-wise steps can still be applied after it
+    bool virtual process_reads_pixels() const { return true; }
 #endif
     const ColorRanges virtual *meta(Images&, const ColorRanges *srcRanges) { return new DupColorRanges(srcRanges); }
     void virtual invData(Images&, FLIF_UNUSED(uint32_t strideCol)=1, FLIF_UNUSED(uint32_t strideRow)=1) const {}
+    // Transforms whose invData() works pixel by pixel can also do it one row at a time, at full resolution, on one buffer
+    // of cols values per plane (they may reorder the row pointers). The decoder fuses these with the output conversion.
+    bool virtual inv_row_wise() const { return false; }
+    void virtual invData_row(ColorVal **, const int /*nump*/, const uint32_t /*cols*/) const {}
     bool virtual is_palette_transform() const { return false; }
 };
+
+// Undoes a row-wise transform on the first nump planes of a fully decoded image, one row at a time.
+template <typename IO>
+void invData_rows(const Transform<IO> &transform, Image &image, const int nump) {
+    const uint32_t cols = image.cols();
+    std::vector<ColorVal> buffer((size_t)nump * cols);
+    std::vector<ColorVal*> row(nump);
+    for (uint32_t r = 0; r < image.rows(); r++) {
+        for (int p = 0; p < nump; p++) {
+            row[p] = &buffer[(size_t)p * cols];
+            image.get_row(p, r, row[p]);
+        }
+        transform.invData_row(row.data(), nump, cols);
+        for (int p = 0; p < nump; p++) image.set_row(p, r, row[p]);
+    }
+}
+
+#ifdef HAS_ENCODER
+// Applies the data_row() steps of the given row-wise transforms, in order, to every row of the images.
+// Bands of rows are processed in parallel.
+template <typename IO>
+void data_rows(const std::vector<const Transform<IO>*> &transforms, Images &images, const int nb_threads) {
+    if (transforms.empty() || images.empty()) return;
+    const uint32_t rows = images[0].rows(), cols = images[0].cols();
+    const int nump = images[0].numPlanes();
+    const uint32_t band = 64;
+    const size_t bands_per_image = (rows + band - 1) / band;
+    parallel_for(images.size() * bands_per_image, nb_threads, [&](size_t i) {
+        Image &image = images[i / bands_per_image];
+        std::vector<ColorVal> buffer((size_t)nump * cols);
+        std::vector<ColorVal*> row(nump);
+        const uint32_t begin = (i % bands_per_image) * band, end = std::min(rows, begin + band);
+        for (uint32_t r = begin; r < end; r++) {
+            for (int p = 0; p < nump; p++) {
+                row[p] = &buffer[(size_t)p * cols];
+                image.get_row(p, r, row[p]);
+            }
+            for (const Transform<IO> *t : transforms) t->data_row(row.data(), nump, cols);
+            for (int p = 0; p < nump; p++) image.set_row(p, r, row[p]);
+        }
+    });
+}
+#endif
@@ -22,6 +22,7 @@ limitations under the License.
 #include "../image/image.hpp"
 #include "../image/color_range.hpp"
 #include "transform.hpp"
+#include "rowkernels.hpp"
 #include <algorithm>
 
 #define clip(x,l,u)   if ((x) < (l)) {(x)=(l);} else if ((x) > (u)) {(x)=(u);}
@@ -170,6 +171,11 @@ public:
          else if (p==0) { minv=0; maxv=get_max_y(par); return;}
          else ranges->minmax(p,pp,minv,maxv);
     }
+    // same as the default snap(), but with a non-virtual call to minmax()
+    void snap(const int p, const prevPlanes &pp, ColorVal &minv, ColorVal &maxv, ColorVal &v) const override {
+        ColorRangesYCoCg::minmax(p,pp,minv,maxv);
+        clamp(minv,maxv,v);
+    }
 };
 
 
@@ -199,32 +205,19 @@ public:
         if (images[0].palette) return false; // skip YCoCg if the image is already a palette image
         return true;
     }
-    void data(Images& images) const override {
-//        printf("TransformYCoCg::data: par=%i\n", par);
-        ColorVal R,G,B,Y,Co,Cg;
-        for (Image& image : images)
-        for (uint32_t r=0; r<image.rows(); r++) {
-            for (uint32_t c=0; c<image.cols(); c++) {
-                R=image(0,r,c);
-                G=image(1,r,c);
-                B=image(2,r,c);
-
-                Y = (((R + B)>>1) + G)>>1;
-                Co = R - B;
-                Cg = G - ((R + B)>>1);
-/* alternative: (not exactly the same!)
-                Co = R - B;
-                ColorVal p = B + Co/2;
-                Cg = G - p;
-                Y = p + Cg/2;
-*/
-                image.set(0,r,c, Y);
-                image.set(1,r,c, Co);
-                image.set(2,r,c, Cg);
-            }
-        }
+    bool process_reads_pixels() const override { return false; }
+    bool is_row_wise() const override { return true; }
+    void data_row(ColorVal **row, const int, const uint32_t cols) const override {
+        row_kernels().ycocg_forward(row[0], row[1], row[2], cols);
     }
+    void data(Images& images) const override { data_rows<IO>({this}, images, 1); }
 #endif
+    bool inv_row_wise() const override { return true; }
+    void invData_row(ColorVal **row, const int, const uint32_t cols) const override {
+        const ColorVal max[3] = {ranges->max(0), ranges->max(1), ranges->max(2)};
+        row_kernels().ycocg_inverse(row[0], row[1], row[2], cols, max);
+    }
+
     void invData(Images& images, uint32_t strideCol, uint32_t strideRow) const override {
         const ColorVal max[3] = {ranges->max(0), ranges->max(1), ranges->max(2)};
         for (Image& image : images) {
@@ -232,6 +225,8 @@ public:
           image.undo_make_constant_plane(1);
           image.undo_make_constant_plane(2);
 
+          if (strideCol == 1 && strideRow == 1 && image.getscale() == 0) { invData_rows(*this, image, 3); continue; }
+
           const uint32_t scaledRows = image.scaledRows();
           const uint32_t scaledCols = image.scaledCols();
 
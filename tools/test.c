@@ -9,6 +9,7 @@
 #include <flif.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #pragma pack(push,1)
 typedef struct RGBA
@@ -192,6 +193,27 @@ int compare_file_and_blob(const void* blob, size_t blob_size, const char* filena
     return result;
 }
 
+// write callback that appends to a growing buffer
+typedef struct Sink
+{
+    uint8_t* data;
+    size_t size;
+    int calls;
+} Sink;
+
+int32_t append_to_sink(const void* data, size_t size, void* user_data)
+{
+    Sink* sink = (Sink*)user_data;
+    uint8_t* grown = (uint8_t*)realloc(sink->data, sink->size + size);
+    if(grown == 0)
+        return 0;
+    memcpy(grown + sink->size, data, size);
+    sink->data = grown;
+    sink->size += size;
+    sink->calls++;
+    return 1;
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 2)
@@ -253,11 +275,37 @@ int main(int argc, char** argv)
                 result = 1;
             }
 
-            // TODO: uncommenting this causes subsequent test to fail???
-            /*if(!compare_file_and_blob(blob, blob_size, dummy_file))
+            if(compare_file_and_blob(blob, blob_size, dummy_file) != 0)
             {
                 result = 1;
-            }*/
+            }
+
+            flif_destroy_encoder(e);
+            e = 0;
+        }
+        e = flif_create_encoder();
+        if(e)
+        {
+            // the same file once more, but handed over in blocks through a callback
+            Sink sink = {0, 0, 0};
+            flif_encoder_set_interlaced(e, 1);
+            flif_encoder_set_learn_repeat(e, 3);
+            flif_encoder_set_auto_color_buckets(e, 1);
+            flif_encoder_set_palette_size(e, 512);
+            flif_encoder_set_lookback(e, 1);
+
+            flif_encoder_add_image(e, im);
+            if(!flif_encoder_encode_callback(e, append_to_sink, &sink))
+            {
+                printf("Error: encoding to a callback failed\n");
+                result = 1;
+            }
+            else if(sink.calls == 0 || compare_file_and_blob(sink.data, sink.size, dummy_file) != 0)
+            {
+                printf("Error: callback output differs from the file\n");
+                result = 1;
+            }
+            free(sink.data);
 
             flif_destroy_encoder(e);
             e = 0;
@@ -307,6 +355,113 @@ int main(int argc, char** argv)
                 }
             }
 
+            {
+                // incremental decoding, feeding the blob in small chunks
+                size_t pos = 0;
+                while(pos < blob_size)
+                {
+                    size_t len = blob_size - pos < 1000 ? blob_size - pos : 1000;
+                    if(!flif_decoder_feed(d, (const uint8_t*)blob + pos, len))
+                    {
+                        printf("Error: feeding the decoder failed\n");
+                        result = 1;
+                        break;
+                    }
+                    pos += len;
+                }
+                if(!flif_decoder_feed_end(d))
+                {
+                    printf("Error: incremental decoding failed\n");
+                    result = 1;
+                }
+
+                FLIF_IMAGE* decoded = flif_decoder_get_image(d, 0);
+                if(decoded == 0)
+                {
+                    printf("Error: No decoded image found\n");
+                    result = 1;
+                }
+                else if(compare_images(im, decoded) != 0)
+                {
+                    result = 1;
+                }
+            }
+
+            {
+                // decode straight into a caller-owned buffer, with padding at the end of each row
+                const size_t stride = (WIDTH + 3) * sizeof(RGBA);
+                uint8_t* pixels = (uint8_t*)malloc(stride * HEIGHT);
+                RGBA* row = (RGBA*)malloc(WIDTH * sizeof(RGBA));
+                if(pixels == 0 || row == 0)
+                {
+                    printf("Error: Out of memory\n");
+                    result = 1;
+                }
+                else
+                {
+                    flif_decoder_set_output_RGBA8(d, pixels, WIDTH, HEIGHT, stride);
+                    if(!flif_decoder_decode_memory(d, blob, blob_size))
+                    {
+                        printf("Error: decoding memory into a buffer failed\n");
+                        result = 1;
+                    }
+                    else
+                    {
+                        uint32_t y;
+                        for(y = 0; y < HEIGHT; ++y)
+                        {
+                            flif_image_read_row_RGBA8(im, y, row, WIDTH * sizeof(RGBA));
+                            if(memcmp(row, pixels + y * stride, WIDTH * sizeof(RGBA)))
+                            {
+                                printf("Error: Buffer differs from the original image in row %u\n", y);
+                                result = 1;
+                                break;
+                            }
+                        }
+                    }
+                    flif_decoder_set_output_RGBA8(d, NULL, 0, 0, 0);
+                }
+                free(row);
+                free(pixels);
+            }
+
+            {
+                // decode only a window of the image
+                const uint32_t cx = 37, cy = 100, cw = 50, ch = 21;
+                RGBA* row = (RGBA*)malloc(WIDTH * sizeof(RGBA));
+                RGBA* crop_row = (RGBA*)malloc(cw * sizeof(RGBA));
+                flif_decoder_set_crop(d, cx, cy, cw, ch);
+                if(!flif_decoder_decode_memory(d, blob, blob_size))
+                {
+                    printf("Error: decoding a cropped image failed\n");
+                    result = 1;
+                }
+                else
+                {
+                    FLIF_IMAGE* decoded = flif_decoder_get_image(d, 0);
+                    uint32_t y;
+                    if(flif_image_get_width(decoded) != cw || flif_image_get_height(decoded) != ch)
+                    {
+                        printf("Error: cropped image has the wrong size\n");
+                        result = 1;
+                    }
+                    else for(y = 0; y < ch; ++y)
+                    {
+                        flif_image_read_row_RGBA8(im, cy + y, row, WIDTH * sizeof(RGBA));
+                        flif_image_read_row_RGBA8(decoded, y, crop_row, cw * sizeof(RGBA));
+                        if(memcmp(row + cx, crop_row, cw * sizeof(RGBA)))
+                        {
+                            printf("Error: Cropped image differs from the original image in row %u\n", cy + y);
+                            result = 1;
+                            break;
+                        }
+                    }
+                }
+                flif_decoder_set_crop(d, 0, 0, 0, 0);
+                free(crop_row);
+                free(row);
+            }
+
             flif_destroy_decoder(d);
             d = 0;
         }
@@ -342,6 +497,105 @@ int main(int argc, char** argv)
             result = 1;
         }
 
+        // truncation index: serve only the part of the file needed for scale 1:2, without decoding
+        e = flif_create_encoder();
+        if(e)
+        {
+            void* indexed = 0;
+            size_t indexed_size = 0;
+            flif_encoder_set_interlaced(e, 1);
+            flif_encoder_set_truncation_index(e, 1);
+            flif_encoder_add_image(e, im);
+            if(!flif_encoder_encode_memory(e, &indexed, &indexed_size))
+            {
+                printf("Error: encoding blob with truncation index failed\n");
+                result = 1;
+            }
+            else
+            {
+                size_t length = flif_truncate_memory(indexed, indexed_size, 2, 100);
+                if(length == 0 || length >= indexed_size || flif_truncate_memory(blob, blob_size, 2, 100) != 0)
+                {
+                    printf("Error: flif_truncate_memory gave %" F_BLOB_SIZE_T " of %" F_BLOB_SIZE_T " bytes\n", length, indexed_size);
+                    result = 1;
+                }
+                else
+                {
+                    FLIF_DECODER* full = flif_create_decoder();
+                    FLIF_DECODER* truncated = flif_create_decoder();
+                    flif_decoder_set_scale(full, 2);
+                    flif_decoder_set_scale(truncated, 2);
+                    if(!flif_decoder_decode_memory(full, indexed, indexed_size) || !flif_decoder_decode_memory(truncated, indexed, length))
+                    {
+                        printf("Error: decoding the truncated blob failed\n");
+                        result = 1;
+                    }
+                    else if(compare_images(flif_decoder_get_image(full, 0), flif_decoder_get_image(truncated, 0)) != 0)
+                    {
+                        result = 1;
+                    }
+                    flif_destroy_decoder(full);
+                    flif_destroy_decoder(truncated);
+                }
+                flif_free_memory(indexed);
+            }
+            flif_destroy_encoder(e);
+            e = 0;
+        }
+
+        // statistics: the decoder must see exactly the symbols the encoder wrote
+        e = flif_create_encoder();
+        if(e)
+        {
+            void* counted = 0;
+            size_t counted_size = 0;
+            flif_encoder_set_stats(e, 1);
+            flif_encoder_add_image(e, im);
+            if(!flif_encoder_encode_memory(e, &counted, &counted_size))
+            {
+                printf("Error: encoding blob with statistics failed\n");
+                result = 1;
+            }
+            else
+            {
+                FLIF_DECODER* d = flif_create_decoder();
+                flif_decoder_set_stats(d, 1);
+                if(!flif_decoder_decode_memory(d, counted, counted_size))
+                {
+                    printf("Error: decoding blob with statistics failed\n");
+                    result = 1;
+                }
+                else
+                {
+                    FLIF_STATS* es = flif_encoder_get_stats(e);
+                    FLIF_STATS* ds = flif_decoder_get_stats(d);
+                    int64_t encoded_symbols = 0, decoded_symbols = 0, decoded_bytes = 0;
+                    int p, z;
+                    for(p = 0; p < flif_stats_num_planes(es); ++p)
+                        for(z = 0; z < flif_stats_num_zoomlevels(es); ++z)
+                            encoded_symbols += flif_stats_get_symbols(es, p, z);
+                    for(p = 0; p < flif_stats_num_planes(ds); ++p)
+                        for(z = 0; z < flif_stats_num_zoomlevels(ds); ++z)
+                        {
+                            decoded_symbols += flif_stats_get_symbols(ds, p, z);
+                            decoded_bytes += flif_stats_get_bytes(ds, p, z);
+                        }
+                    if(decoded_symbols == 0 || decoded_symbols != encoded_symbols || decoded_bytes <= 0 || (size_t) decoded_bytes > counted_size
+                       || flif_stats_get_tree_nodes(ds, 0) != flif_stats_get_tree_nodes(es, 0)
+                       || flif_stats_get_peak_plane_memory(ds) < (int64_t) (WIDTH * HEIGHT))
+                    {
+                        printf("Error: inconsistent statistics (%d symbols encoded, %d decoded in %d bytes)\n",
+                               (int) encoded_symbols, (int) decoded_symbols, (int) decoded_bytes);
+                        result = 1;
+                    }
+                }
+                flif_destroy_decoder(d);
+                flif_free_memory(counted);
+            }
+            flif_destroy_encoder(e);
+            e = 0;
+        }
+
         flif_destroy_image(im);
         im = 0;
 